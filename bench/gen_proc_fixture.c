@@ -0,0 +1,32 @@
+/* bench/gen_proc_fixture.c
+SPDX-License-Identifier: Apache-2.0
+Copyright 2025 Alexander Scheglov */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "proc_fixture.h"
+
+/*
+ * Build a synthetic procfs tree, e.g. to point pgsyswatch.proc_root at:
+ *   gen_proc_fixture /tmp/fakeproc 10000 16 64
+ */
+int main(int argc, char **argv) {
+    int nprocs = argc > 2 ? atoi(argv[2]) : 1000;
+    int nifaces = argc > 3 ? atoi(argv[3]) : 8;
+    int ncpus = argc > 4 ? atoi(argv[4]) : 16;
+
+    if (argc < 2 || argc > 5 || nprocs < 0 || nifaces < 1 || ncpus < 1) {
+        fprintf(stderr, "usage: %s DIR [processes] [interfaces] [cpus]\n", argv[0]);
+        return 2;
+    }
+
+    if (proc_fixture_generate(argv[1], nprocs, nifaces, ncpus) != 0) {
+        fprintf(stderr, "%s: could not build fixture in %s: %s\n", argv[0], argv[1], strerror(errno));
+        return 1;
+    }
+
+    printf("%s: %d processes, %d interfaces, %d cpus\n", argv[1], nprocs, nifaces, ncpus);
+    return 0;
+}
@@ -0,0 +1,354 @@
+/* bench/pgsyswatch_bench.c
+SPDX-License-Identifier: Apache-2.0
+Copyright 2025 Alexander Scheglov */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pgsyswatch_procfs.h"
+#include "proc_fixture.h"
+
+/*
+ * Standalone benchmark of the procfs parsers.
+ *
+ * For every requested size a fixture tree is generated (see proc_fixture.c),
+ * pgsyswatch_proc_root is pointed at it and the parsers the extension uses
+ * are timed: get_process_info() per PID, the full proc_monitor_all() scan
+ * (PID listing included), the /proc/net/dev read + parse behind
+ * net_monitor() and the /proc/cpuinfo parsing behind pg_loadavg() and
+ * cpu_frequencies(). Each figure is the best of -r runs.
+ *
+ * The scan is then repeated through procfs_scan_processes(), the threaded
+ * scan of the collector worker, once for every thread count of -t, to show
+ * how it scales with pgsyswatch.collector_scan_threads.
+ *
+ * Allocations are counted by interposing malloc and friends, so the
+ * buffers glibc allocates inside fopen() and getline() are included. Each
+ * benchmark has an upper bound on allocations per unit below; exceeding
+ * one fails the run, so that make bench catches an allocation added to a
+ * parser. Timings have no bounds: they depend too much on the host.
+ */
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static unsigned long long allocations = 0;
+
+void *malloc(size_t size) {
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    __libc_free(ptr);
+}
+
+/* Allocation bounds: per file opened, fopen() allocates the FILE and its buffer */
+#define BENCH_MAX_ALLOCS_PER_PID 12.0           /* stat, status, io, cmdline + the command */
+#define BENCH_MAX_ALLOCS_PER_NET_DEV(nifaces) (3.0 + (nifaces) / 32.0)  /* net/dev + the result, growing */
+#define BENCH_MAX_ALLOCS_PER_CPUINFO 5.0        /* cpuinfo twice + the frequencies */
+
+/* Benchmarks over their allocation bound */
+static int failures = 0;
+
+typedef struct BenchResult {
+    double ns_per_unit;
+    double allocs_per_unit;
+} BenchResult;
+
+/* Function to read a monotonic clock in nanoseconds */
+static double now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Keep the optimizer from dropping parsed values */
+static volatile unsigned long long sink;
+
+/* Benchmark: get_process_info() over an already listed set of PIDs */
+static BenchResult bench_get_process_info(const int *pids, int npids) {
+    BenchResult result;
+    unsigned long long start_allocs = allocations;
+    double start = now_ns();
+    int i;
+
+    for (i = 0; i < npids; i++) {
+        ProcessInfo process = get_process_info(pids[i]);
+
+        sink += process.utime + process.read_bytes;
+        free(process.command);
+    }
+
+    result.ns_per_unit = (now_ns() - start) / npids;
+    result.allocs_per_unit = (double) (allocations - start_allocs) / npids;
+    return result;
+}
+
+/* Benchmark: the whole proc_monitor_all() scan, listing included */
+static BenchResult bench_scan(int expected) {
+    BenchResult result;
+    unsigned long long start_allocs = allocations;
+    double start = now_ns();
+    int *pids;
+    int npids = procfs_read_pids(&pids);
+    int i;
+
+    for (i = 0; i < npids; i++) {
+        ProcessInfo process = get_process_info(pids[i]);
+
+        sink += process.stime;
+        free(process.command);
+    }
+    free(pids);
+
+    if (npids != expected) {
+        fprintf(stderr, "scan found %d processes, expected %d\n", npids, expected);
+        exit(1);
+    }
+    result.ns_per_unit = (now_ns() - start) / npids;
+    result.allocs_per_unit = (double) (allocations - start_allocs) / npids;
+    return result;
+}
+
+/* Benchmark: read and parse /proc/net/dev the way net_monitor() does, per call */
+static BenchResult bench_net_dev(int calls, int nifaces) {
+    BenchResult result;
+    unsigned long long start_allocs = allocations;
+    double start = now_ns();
+    int c;
+
+    for (c = 0; c < calls; c++) {
+        char *lines = procfs_read_net_dev();
+        const char *line;
+        NetDevInfo info;
+        int parsed = 0;
+
+        if (lines == NULL) {
+            fprintf(stderr, "could not read %s/net/dev\n", procfs_root());
+            exit(1);
+        }
+        /* One interface per line, as net_monitor() walks them */
+        for (line = lines; *line != '\0' && procfs_parse_net_dev_line(line, &info); ) {
+            sink += info.receive_bytes;
+            parsed++;
+            line = strchr(line, '\n');
+            if (line == NULL)
+                break;
+            line++;
+        }
+        free(lines);
+        if (parsed != nifaces) {
+            fprintf(stderr, "parsed %d interfaces, expected %d\n", parsed, nifaces);
+            exit(1);
+        }
+    }
+
+    result.ns_per_unit = (now_ns() - start) / calls;
+    result.allocs_per_unit = (double) (allocations - start_allocs) / calls;
+    return result;
+}
+
+/* Benchmark: /proc/cpuinfo parsing (core count + frequencies), per call */
+static BenchResult bench_cpuinfo(int calls, int ncpus) {
+    BenchResult result;
+    unsigned long long start_allocs = allocations;
+    double start = now_ns();
+    int c;
+
+    for (c = 0; c < calls; c++) {
+        int cores = procfs_count_cpus();
+        CpuFrequencyInfo *frequencies = malloc(sizeof(CpuFrequencyInfo) * (cores > 0 ? cores : 1));
+
+        if (cores != ncpus || procfs_read_cpu_frequencies(frequencies, cores) != ncpus) {
+            fprintf(stderr, "cpuinfo parsing found %d cores, expected %d\n", cores, ncpus);
+            exit(1);
+        }
+        sink += (unsigned long long) frequencies[0].frequency_mhz;
+        free(frequencies);
+    }
+
+    result.ns_per_unit = (now_ns() - start) / calls;
+    result.allocs_per_unit = (double) (allocations - start_allocs) / calls;
+    return result;
+}
+
+/* Benchmark: the threaded scan of the collector worker over an already listed set of PIDs */
+static BenchResult bench_scan_threads(const int *pids, int npids, int nthreads) {
+    BenchResult result;
+    unsigned long long start_allocs = allocations;
+    double start = now_ns();
+    ProcessInfo *processes = procfs_scan_processes(pids, npids, nthreads);
+    int i;
+
+    if (processes == NULL) {
+        fprintf(stderr, "threaded scan ran out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < npids; i++) {
+        if (processes[i].pid != pids[i]) {
+            fprintf(stderr, "threaded scan returned PID %d at %d, expected %d\n", processes[i].pid, i, pids[i]);
+            exit(1);
+        }
+        sink += processes[i].utime;
+        free(processes[i].command);
+    }
+    free(processes);
+
+    result.ns_per_unit = (now_ns() - start) / npids;
+    result.allocs_per_unit = (double) (allocations - start_allocs) / npids;
+    return result;
+}
+
+/* Function to keep the fastest of several runs */
+static void keep_best(BenchResult *best, BenchResult run, int first) {
+    if (first || run.ns_per_unit < best->ns_per_unit) {
+        *best = run;
+    }
+}
+
+/* Function to print one result line and check it against its allocation bound */
+static void report(int nprocs, const char *name, BenchResult result, const char *unit, double max_allocs) {
+    printf("%10d  %-18s %14.1f %12.2f  %s\n", nprocs, name, result.ns_per_unit, result.allocs_per_unit, unit);
+    if (result.allocs_per_unit > max_allocs) {
+        fprintf(stderr, "FAIL: %s made %.2f allocations per %s, bound is %.2f\n",
+                name, result.allocs_per_unit, unit, max_allocs);
+        failures++;
+    }
+}
+
+static void usage(const char *progname) {
+    fprintf(stderr,
+            "usage: %s [-s sizes] [-t threads] [-r repeats] [-i interfaces] [-c cpus] [-d dir] [-k]\n"
+            "  -s  comma separated process counts (default 1000,10000,100000)\n"
+            "  -t  comma separated thread counts for the threaded scan (default 1,2,4,8)\n"
+            "  -r  runs per benchmark, the best is reported (default 3)\n"
+            "  -i  interfaces in net/dev (default 16)\n"
+            "  -c  processors in cpuinfo (default 64)\n"
+            "  -d  directory for the fixture trees (default $TMPDIR or /tmp)\n"
+            "  -k  keep the fixture trees\n",
+            progname);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    const char *sizes = "1000,10000,100000";
+    const char *thread_counts = "1,2,4,8";
+    const char *basedir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    int repeats = 3;
+    int nifaces = 16;
+    int ncpus = 64;
+    int keep = 0;
+    char *sizes_copy;
+    char *token;
+    char *saveptr;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:t:r:i:c:d:k")) != -1) {
+        switch (opt) {
+            case 's': sizes = optarg; break;
+            case 't': thread_counts = optarg; break;
+            case 'r': repeats = atoi(optarg); break;
+            case 'i': nifaces = atoi(optarg); break;
+            case 'c': ncpus = atoi(optarg); break;
+            case 'd': basedir = optarg; break;
+            case 'k': keep = 1; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (repeats < 1 || nifaces < 1 || ncpus < 1) {
+        usage(argv[0]);
+    }
+
+    printf("%10s  %-18s %14s %12s  %s\n", "processes", "benchmark", "ns/unit", "allocs/unit", "unit");
+
+    sizes_copy = strdup(sizes);
+    for (token = strtok_r(sizes_copy, ",", &saveptr); token != NULL; token = strtok_r(NULL, ",", &saveptr)) {
+        int nprocs = atoi(token);
+        char dir[PATH_MAX];
+        BenchResult best[4] = {{0}};
+        char *threads_copy;
+        char *thread_token;
+        char *thread_saveptr;
+        int *pids;
+        int npids;
+        int r;
+        double start;
+
+        if (nprocs < 1) {
+            usage(argv[0]);
+        }
+
+        snprintf(dir, sizeof(dir), "%s/pgsyswatch_bench.%d.XXXXXX", basedir, nprocs);
+        if (mkdtemp(dir) == NULL) {
+            fprintf(stderr, "could not create %s: %s\n", dir, strerror(errno));
+            return 1;
+        }
+        start = now_ns();
+        if (proc_fixture_generate(dir, nprocs, nifaces, ncpus) != 0) {
+            fprintf(stderr, "could not build fixture in %s: %s\n", dir, strerror(errno));
+            proc_fixture_remove(dir);
+            return 1;
+        }
+        fprintf(stderr, "fixture %s built in %.1f s\n", dir, (now_ns() - start) / 1e9);
+        pgsyswatch_proc_root = dir;
+
+        npids = procfs_read_pids(&pids);
+        for (r = 0; r < repeats; r++) {
+            keep_best(&best[0], bench_get_process_info(pids, npids), r == 0);
+            keep_best(&best[1], bench_scan(nprocs), r == 0);
+            keep_best(&best[2], bench_net_dev(1000, nifaces), r == 0);
+            keep_best(&best[3], bench_cpuinfo(100, ncpus), r == 0);
+        }
+
+        report(nprocs, "get_process_info", best[0], "pid", BENCH_MAX_ALLOCS_PER_PID);
+        report(nprocs, "proc_monitor_all", best[1], "pid", BENCH_MAX_ALLOCS_PER_PID);
+        report(nprocs, "net_monitor", best[2], "call", BENCH_MAX_ALLOCS_PER_NET_DEV(nifaces));
+        report(nprocs, "cpuinfo", best[3], "call", BENCH_MAX_ALLOCS_PER_CPUINFO);
+
+        threads_copy = strdup(thread_counts);
+        for (thread_token = strtok_r(threads_copy, ",", &thread_saveptr); thread_token != NULL;
+             thread_token = strtok_r(NULL, ",", &thread_saveptr)) {
+            int nthreads = atoi(thread_token);
+            BenchResult scan_best = {0};
+            char name[32];
+
+            if (nthreads < 1) {
+                usage(argv[0]);
+            }
+            for (r = 0; r < repeats; r++) {
+                keep_best(&scan_best, bench_scan_threads(pids, npids, nthreads), r == 0);
+            }
+            snprintf(name, sizeof(name), "scan_threads=%d", nthreads);
+            report(nprocs, name, scan_best, "pid", BENCH_MAX_ALLOCS_PER_PID);
+        }
+        free(threads_copy);
+        free(pids);
+
+        pgsyswatch_proc_root = NULL;
+        if (!keep) {
+            proc_fixture_remove(dir);
+        }
+    }
+    free(sizes_copy);
+
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,340 @@
+/* bench/proc_fixture.c
+SPDX-License-Identifier: Apache-2.0
+Copyright 2025 Alexander Scheglov */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "proc_fixture.h"
+
+/*
+ * Creating 100k process directories with four distinct files each would
+ * cost ~1.6 GB of tmpfs pages. Instead a pool of TEMPLATE_COUNT template
+ * processes is written once and every process directory hard-links its
+ * files from one of them. The parsers see the same file formats and the
+ * same number of open/read calls; only the pid field inside stat does not
+ * match the directory name, which none of the parsers look at.
+ */
+
+#define TEMPLATE_COUNT 64
+#define TEMPLATE_DIR ".templates"
+
+#define Min(x, y) ((x) < (y) ? (x) : (y))
+#define Max(x, y) ((x) > (y) ? (x) : (y))
+
+static const char *process_files[] = {"stat", "status", "io", "cmdline"};
+
+/* Function to write a whole file */
+static int write_file(const char *path, const char *data, size_t len) {
+    FILE *file = fopen(path, "w");
+
+    if (file == NULL) {
+        return -1;
+    }
+    if (len > 0 && fwrite(data, 1, len, file) != len) {
+        fclose(file);
+        return -1;
+    }
+    return fclose(file);
+}
+
+/* Function to write a formatted file */
+static int write_filef(const char *path, const char *format, ...) __attribute__((format(printf, 2, 3)));
+static int write_filef(const char *path, const char *format, ...) {
+    char *data;
+    int len;
+    int ret;
+    va_list args;
+
+    va_start(args, format);
+    len = vasprintf(&data, format, args);
+    va_end(args);
+    if (len < 0) {
+        return -1;
+    }
+    ret = write_file(path, data, len);
+    free(data);
+    return ret;
+}
+
+/* Function to write the four files of one template process */
+static int write_template(const char *dir, int template_id) {
+    char path[PATH_MAX];
+    char cmdline[512];
+    size_t cmdline_len;
+    const char *comm;
+    char state;
+    int kernel_thread = (template_id % 16 == 15);
+    int zombie = (template_id % 32 == 7);
+    int threads = (template_id % 8 == 3) ? 40 + template_id : 1;
+    unsigned long vsize_kb = 160000 + template_id * 977;
+    unsigned long rss_kb = kernel_thread ? 0 : 9000 + template_id * 131;
+    unsigned long swap_kb = (template_id % 5 == 0) ? template_id * 64 : 0;
+    unsigned long long utime = template_id * 37ULL;
+    unsigned long long stime = template_id * 11ULL;
+    int pid = 100000 + template_id;
+
+    /* A mix of backends, other daemons, kernel threads and zombies */
+    if (kernel_thread) {
+        comm = "kworker/3:1-events";
+        state = 'I';
+        cmdline_len = 0;
+    } else if (template_id % 8 == 3) {
+        comm = "java";
+        state = 'S';
+        cmdline_len = snprintf(cmdline, sizeof(cmdline),
+                               "/usr/bin/java%c-Xmx4g%c-XX:+UseG1GC%c-Dapp.name=exporter-%d%c-jar%c/opt/exporter/exporter.jar",
+                               '\0', '\0', '\0', template_id, '\0', '\0') + 1;
+    } else {
+        static const char *activity[] = {"idle", "SELECT", "INSERT", "idle in transaction", "COPY", "UPDATE"};
+
+        comm = "postgres";
+        state = zombie ? 'Z' : (template_id % 6 == 1 ? 'R' : (template_id % 23 == 4 ? 'D' : 'S'));
+        cmdline_len = snprintf(cmdline, sizeof(cmdline), "postgres: app_user%d appdb 10.0.%d.%d(%d) %s",
+                               template_id % 7, template_id % 4, template_id, 40000 + template_id,
+                               activity[template_id % 6]) + 1;
+        /* Backends overwrite argv in place, so the title is padded with NULs */
+        memset(cmdline + cmdline_len, '\0', 64);
+        cmdline_len += 64;
+    }
+    if (zombie) {
+        cmdline_len = 0;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s/%d", dir, TEMPLATE_DIR, template_id);
+    if (mkdir(path, 0755) != 0) {
+        return -1;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s/%d/stat", dir, TEMPLATE_DIR, template_id);
+    if (write_filef(path,
+                    "%d (%s) %c 1 %d %d 0 -1 %u %lu 0 %lu 0 %llu %llu 0 0 20 0 %d 0 %llu %lu %lu "
+                    "18446744073709551615 94251373932544 94251382335141 140724318316064 0 0 0 0 "
+                    "20975616 536890887 0 0 0 17 %d 0 0 %d 0 0 94251385009328 94251385282480 "
+                    "94251391303680 140724318321379 140724318321442 140724318321442 140724318322664 0\n",
+                    pid, comm, state, pid, pid, kernel_thread ? 69238880u : 4194560u,
+                    1200UL + template_id * 17, (unsigned long) template_id % 3,
+                    utime, stime, threads, 2000000ULL + template_id * 1000ULL,
+                    vsize_kb * 1024, rss_kb / 4, template_id % 8, template_id % 5) != 0) {
+        return -1;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s/%d/status", dir, TEMPLATE_DIR, template_id);
+    if (kernel_thread || zombie) {
+        /* Kernel threads and zombies have no Vm* lines */
+        if (write_filef(path,
+                        "Name:\t%s\nUmask:\t0000\nState:\t%c (%s)\nTgid:\t%d\nNgid:\t0\nPid:\t%d\nPPid:\t2\n"
+                        "TracerPid:\t0\nUid:\t0\t0\t0\t0\nGid:\t0\t0\t0\t0\nFDSize:\t64\nGroups:\t\n"
+                        "NStgid:\t%d\nNSpid:\t%d\nNSpgid:\t0\nNSsid:\t0\nThreads:\t1\nSigQ:\t0/63448\n"
+                        "SigPnd:\t0000000000000000\nShdPnd:\t0000000000000000\nSigBlk:\t0000000000000000\n"
+                        "SigIgn:\tffffffffffffffff\nSigCgt:\t0000000000000000\nCapInh:\t0000000000000000\n"
+                        "CapPrm:\t000001ffffffffff\nCapEff:\t000001ffffffffff\nCapBnd:\t000001ffffffffff\n"
+                        "CapAmb:\t0000000000000000\nNoNewPrivs:\t0\nSeccomp:\t0\nSeccomp_filters:\t0\n"
+                        "Speculation_Store_Bypass:\tthread vulnerable\nSpeculationIndirectBranch:\tconditional enabled\n"
+                        "Cpus_allowed:\tff\nCpus_allowed_list:\t0-7\nMems_allowed:\t00000000,00000001\n"
+                        "Mems_allowed_list:\t0\nvoluntary_ctxt_switches:\t%d\nnonvoluntary_ctxt_switches:\t%d\n",
+                        comm, state, zombie ? "zombie" : "idle", pid, pid, pid, pid,
+                        template_id * 101, template_id * 3) != 0) {
+            return -1;
+        }
+    } else {
+        if (write_filef(path,
+                        "Name:\t%s\nUmask:\t0077\nState:\t%c (%s)\nTgid:\t%d\nNgid:\t0\nPid:\t%d\nPPid:\t1\n"
+                        "TracerPid:\t0\nUid:\t999\t999\t999\t999\nGid:\t999\t999\t999\t999\nFDSize:\t64\n"
+                        "Groups:\t999 \nNStgid:\t%d\nNSpid:\t%d\nNSpgid:\t%d\nNSsid:\t%d\n"
+                        "VmPeak:\t%8lu kB\nVmSize:\t%8lu kB\nVmLck:\t       0 kB\nVmPin:\t       0 kB\n"
+                        "VmHWM:\t%8lu kB\nVmRSS:\t%8lu kB\nRssAnon:\t%8lu kB\nRssFile:\t%8lu kB\nRssShmem:\t%8lu kB\n"
+                        "VmData:\t    5316 kB\nVmStk:\t     132 kB\nVmExe:\t    8512 kB\nVmLib:\t   12388 kB\n"
+                        "VmPTE:\t     196 kB\nVmSwap:\t%8lu kB\nHugetlbPages:\t       0 kB\nCoreDumping:\t0\n"
+                        "THP_enabled:\t1\nThreads:\t%d\nSigQ:\t0/63448\nSigPnd:\t0000000000000000\n"
+                        "ShdPnd:\t0000000000000000\nSigBlk:\t0000000000000000\nSigIgn:\t0000000001301800\n"
+                        "SigCgt:\t0000000180006287\nCapInh:\t0000000000000000\nCapPrm:\t0000000000000000\n"
+                        "CapEff:\t0000000000000000\nCapBnd:\t000001ffffffffff\nCapAmb:\t0000000000000000\n"
+                        "NoNewPrivs:\t0\nSeccomp:\t0\nSeccomp_filters:\t0\n"
+                        "Speculation_Store_Bypass:\tthread vulnerable\nSpeculationIndirectBranch:\tconditional enabled\n"
+                        "Cpus_allowed:\tff\nCpus_allowed_list:\t0-7\nMems_allowed:\t00000000,00000001\n"
+                        "Mems_allowed_list:\t0\nvoluntary_ctxt_switches:\t%d\nnonvoluntary_ctxt_switches:\t%d\n",
+                        comm, state, state == 'R' ? "running" : (state == 'D' ? "disk sleep" : "sleeping"),
+                        pid, pid, pid, pid, pid, pid,
+                        vsize_kb + 4096, vsize_kb, rss_kb + 512, rss_kb, rss_kb / 4, rss_kb / 2, rss_kb / 4,
+                        swap_kb, threads, template_id * 251, template_id * 7) != 0) {
+            return -1;
+        }
+    }
+
+    snprintf(path, sizeof(path), "%s/%s/%d/io", dir, TEMPLATE_DIR, template_id);
+    if (write_filef(path,
+                    "rchar: %lu\nwchar: %lu\nsyscr: %lu\nsyscw: %lu\nread_bytes: %lu\nwrite_bytes: %lu\n"
+                    "cancelled_write_bytes: %lu\n",
+                    template_id * 912345UL, template_id * 412345UL, template_id * 913UL, template_id * 411UL,
+                    template_id * 32768UL, template_id * 8192UL, template_id * 4096UL) != 0) {
+        return -1;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s/%d/cmdline", dir, TEMPLATE_DIR, template_id);
+    return write_file(path, cmdline, cmdline_len);
+}
+
+/* Function to write the system-wide files */
+static int write_system_files(const char *dir, int nprocs, int nifaces, int ncpus) {
+    char path[PATH_MAX];
+    FILE *file;
+    int i;
+
+    snprintf(path, sizeof(path), "%s/uptime", dir);
+    if (write_filef(path, "%.2f %.2f\n", 1234567.89, 1234567.89 * ncpus * 0.9) != 0) {
+        return -1;
+    }
+
+    snprintf(path, sizeof(path), "%s/loadavg", dir);
+    if (write_filef(path, "%.2f %.2f %.2f %d/%d %d\n", ncpus * 0.41, ncpus * 0.38, ncpus * 0.35,
+                    Min(ncpus, nprocs), nprocs, 100000 + nprocs) != 0) {
+        return -1;
+    }
+
+    snprintf(path, sizeof(path), "%s/meminfo", dir);
+    if (write_filef(path,
+                    "MemTotal:       %8lu kB\nMemFree:         1187416 kB\nMemAvailable:   %8lu kB\n"
+                    "Buffers:          412344 kB\nCached:         %8lu kB\nSwapCached:        12404 kB\n"
+                    "Active:         12455324 kB\nInactive:       10876812 kB\nActive(anon):    4023880 kB\n"
+                    "Inactive(anon):   1004276 kB\nActive(file):    8431444 kB\nInactive(file):   9872536 kB\n"
+                    "Unevictable:       30564 kB\nMlocked:           27492 kB\nSwapTotal:       8388604 kB\n"
+                    "SwapFree:        8123004 kB\nZswap:                 0 kB\nZswapped:              0 kB\n"
+                    "Dirty:              1840 kB\nWriteback:             0 kB\nAnonPages:       4951716 kB\n"
+                    "Mapped:          2209264 kB\nShmem:           4212380 kB\nKReclaimable:     801520 kB\n"
+                    "Slab:            1324220 kB\nSReclaimable:     801520 kB\nSUnreclaim:       522700 kB\n"
+                    "KernelStack:       30096 kB\nPageTables:        86984 kB\nSecPageTables:         0 kB\n"
+                    "NFS_Unstable:          0 kB\nBounce:                0 kB\nWritebackTmp:          0 kB\n"
+                    "CommitLimit:    24836788 kB\nCommitted_AS:   21398268 kB\nVmallocTotal:   34359738367 kB\n"
+                    "VmallocUsed:      163928 kB\nVmallocChunk:          0 kB\nPercpu:            27648 kB\n"
+                    "HardwareCorrupted:     0 kB\nAnonHugePages:    1431552 kB\nShmemHugePages:        0 kB\n"
+                    "ShmemPmdMapped:        0 kB\nFileHugePages:         0 kB\nFilePmdMapped:         0 kB\n"
+                    "HugePages_Total:       0\nHugePages_Free:        0\nHugePages_Rsvd:        0\n"
+                    "HugePages_Surp:        0\nHugepagesize:       2048 kB\nHugetlb:               0 kB\n"
+                    "DirectMap4k:      868172 kB\nDirectMap2M:    24932352 kB\nDirectMap1G:     7340032 kB\n",
+                    32896368UL, 21012340UL, 17854532UL) != 0) {
+        return -1;
+    }
+
+    snprintf(path, sizeof(path), "%s/cpuinfo", dir);
+    file = fopen(path, "w");
+    if (file == NULL) {
+        return -1;
+    }
+    for (i = 0; i < ncpus; i++) {
+        fprintf(file,
+                "processor\t: %d\nvendor_id\t: GenuineIntel\ncpu family\t: 6\nmodel\t\t: 106\n"
+                "model name\t: Intel(R) Xeon(R) Platinum 8380 CPU @ 2.30GHz\nstepping\t: 6\n"
+                "microcode\t: 0xd0003a5\ncpu MHz\t\t: %.3f\ncache size\t: 61440 KB\nphysical id\t: %d\n"
+                "siblings\t: %d\ncore id\t\t: %d\ncpu cores\t: %d\napicid\t\t: %d\ninitial apicid\t: %d\n"
+                "fpu\t\t: yes\nfpu_exception\t: yes\ncpuid level\t: 27\nwp\t\t: yes\n"
+                "flags\t\t: fpu vme de pse tsc msr pae mce cx8 apic sep mtrr pge mca cmov pat pse36 clflush dts "
+                "acpi mmx fxsr sse sse2 ss ht tm pbe syscall nx pdpe1gb rdtscp lm constant_tsc art arch_perfmon "
+                "pebs bts rep_good nopl xtopology nonstop_tsc cpuid aperfmperf pni pclmulqdq dtes64 monitor ds_cpl "
+                "vmx smx est tm2 ssse3 sdbg fma cx16 xtpr pdcm pcid dca sse4_1 sse4_2 x2apic movbe popcnt "
+                "tsc_deadline_timer aes xsave avx f16c rdrand lahf_lm abm 3dnowprefetch cpuid_fault epb cat_l3 "
+                "invpcid_single intel_ppin ssbd mba ibrs ibpb stibp ibrs_enhanced tpr_shadow vnmi flexpriority ept "
+                "vpid ept_ad fsgsbase tsc_adjust bmi1 avx2 smep bmi2 erms invpcid cqm rdt_a avx512f avx512dq rdseed "
+                "adx smap avx512ifma clflushopt clwb intel_pt avx512cd sha_ni avx512bw avx512vl xsaveopt xsavec "
+                "xgetbv1 xsaves cqm_llc cqm_occup_llc cqm_mbm_total cqm_mbm_local split_lock_detect wbnoinvd dtherm "
+                "ida arat pln pts avx512vbmi umip pku ospke avx512_vbmi2 gfni vaes vpclmulqdq avx512_vnni "
+                "avx512_bitalg tme avx512_vpopcntdq la57 rdpid fsrm md_clear pconfig flush_l1d arch_capabilities\n"
+                "vmx flags\t: vnmi preemption_timer posted_intr invvpid ept_x_only ept_ad ept_1gb flexpriority "
+                "apicv tsc_offset vtpr mtf vapic ept vpid unrestricted_guest vapic_reg vid ple shadow_vmcs pml "
+                "ept_mode_based_exec tsc_scaling\n"
+                "bugs\t\t: spectre_v1 spectre_v2 spec_store_bypass swapgs mmio_stale_data eibrs_pbrsb gds bhi\n"
+                "bogomips\t: 4600.00\nclflush size\t: 64\ncache_alignment\t: 64\n"
+                "address sizes\t: 46 bits physical, 57 bits virtual\npower management:\n\n",
+                i, 2300.0 + (i * 37 % 1200), i / Max(ncpus / 2, 1), Max(ncpus / 2, 1), i % Max(ncpus / 2, 1),
+                Max(ncpus / 2, 1), i, i);
+    }
+    if (fclose(file) != 0) {
+        return -1;
+    }
+
+    snprintf(path, sizeof(path), "%s/net", dir);
+    if (mkdir(path, 0755) != 0) {
+        return -1;
+    }
+    snprintf(path, sizeof(path), "%s/net/dev", dir);
+    file = fopen(path, "w");
+    if (file == NULL) {
+        return -1;
+    }
+    fprintf(file, "Inter-|   Receive                                                |  Transmit\n"
+                  " face |bytes    packets errs drop fifo frame compressed multicast|bytes    packets errs drop fifo colls carrier compressed\n");
+    for (i = 0; i < nifaces; i++) {
+        char face[32];
+        unsigned long long scale = (unsigned long long) (i + 1) * 7919;
+
+        if (i == 0) {
+            snprintf(face, sizeof(face), "lo");
+        } else if (i % 3 == 0) {
+            snprintf(face, sizeof(face), "veth%x", 0x5a3c00 + i);
+        } else {
+            snprintf(face, sizeof(face), "ens%d", i);
+        }
+        fprintf(file, "%6s: %7llu %7llu %4llu %4llu %4llu %5llu %10llu %9llu %8llu %7llu %4llu %4llu %4llu %5llu %7llu %10llu\n",
+                face, scale * 1234567, scale * 1021, scale % 7, scale % 3, 0ULL, 0ULL, 0ULL, scale % 97,
+                scale * 765432, scale * 877, scale % 5, scale % 2, 0ULL, 0ULL, 0ULL, 0ULL);
+    }
+    return fclose(file);
+}
+
+/* Function to build the fixture tree */
+int proc_fixture_generate(const char *dir, int nprocs, int nifaces, int ncpus) {
+    char path[PATH_MAX];
+    char source[PATH_MAX];
+    int i;
+    size_t f;
+
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        return -1;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", dir, TEMPLATE_DIR);
+    if (mkdir(path, 0755) != 0) {
+        return -1;
+    }
+    for (i = 0; i < TEMPLATE_COUNT; i++) {
+        if (write_template(dir, i) != 0) {
+            return -1;
+        }
+    }
+
+    /* Process directories start at PID 1, like the real thing */
+    for (i = 1; i <= nprocs; i++) {
+        int template_id = (int) (((unsigned) i * 2654435761u) % TEMPLATE_COUNT);
+
+        snprintf(path, sizeof(path), "%s/%d", dir, i);
+        if (mkdir(path, 0755) != 0) {
+            return -1;
+        }
+        for (f = 0; f < sizeof(process_files) / sizeof(process_files[0]); f++) {
+            snprintf(source, sizeof(source), "%s/%s/%d/%s", dir, TEMPLATE_DIR, template_id, process_files[f]);
+            snprintf(path, sizeof(path), "%s/%d/%s", dir, i, process_files[f]);
+            if (link(source, path) != 0) {
+                return -1;
+            }
+        }
+    }
+
+    return write_system_files(dir, nprocs, nifaces, ncpus);
+}
+
+/* Callback of nftw() for proc_fixture_remove() */
+static int remove_entry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    return remove(path);
+}
+
+/* Function to remove the fixture tree */
+int proc_fixture_remove(const char *dir) {
+    return nftw(dir, remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+}
@@ -0,0 +1,18 @@
+/* bench/proc_fixture.h
+SPDX-License-Identifier: Apache-2.0
+Copyright 2025 Alexander Scheglov */
+#ifndef PROC_FIXTURE_H
+#define PROC_FIXTURE_H
+
+/*
+ * Build a synthetic procfs tree in dir: nprocs process directories with
+ * stat, status, io and cmdline, plus uptime, loadavg, meminfo, cpuinfo
+ * (ncpus processors) and net/dev (nifaces interfaces), all in the formats
+ * the kernel produces. Returns 0 on success, -1 with errno set otherwise.
+ */
+int proc_fixture_generate(const char *dir, int nprocs, int nifaces, int ncpus);
+
+/* Remove a tree built by proc_fixture_generate() */
+int proc_fixture_remove(const char *dir);
+
+#endif  /* PROC_FIXTURE_H */
@@ -0,0 +1,200 @@
+-- pgsyswatch--1.0--1.1.sql
+-- Upgrading the extension from 1.0 to 1.1 (ALTER EXTENSION pgsyswatch UPDATE)
+-- A fresh CREATE EXTENSION runs pgsyswatch--1.0.sql and then this script
+
+-- Setting the default schema for the current session
+SET search_path TO pgsyswatch;
+
+-- Creating variants of pg_loadavg, proc_monitor_all and net_monitor that say how old a shared snapshot may be
+-- max_staleness (ms): NULL uses pgsyswatch.cache_ttl, 0 forces a fresh read
+-- The variants without arguments stay, and use pgsyswatch.cache_ttl
+CREATE FUNCTION pg_loadavg(max_staleness INTEGER)
+RETURNS loadavg_type
+LANGUAGE c
+AS '/usr/local/pgsql/lib/pgsyswatch', 'pg_loadavg';
+
+CREATE FUNCTION proc_monitor_all(max_staleness INTEGER)
+RETURNS SETOF proc_monitor_type
+LANGUAGE c
+AS '/usr/local/pgsql/lib/pgsyswatch', 'proc_monitor_all';
+
+CREATE FUNCTION net_monitor(max_staleness INTEGER)
+RETURNS SETOF net_monitor_type
+LANGUAGE c
+AS '/usr/local/pgsql/lib/pgsyswatch', 'net_monitor';
+
+-- Creating a type for the cost counters of the collectors
+CREATE TYPE collector_stats_type AS (
+    collector TEXT,               -- Data source (named after the function that reads it)
+    scans BIGINT,                 -- Reads of the data source
+    cache_hits BIGINT,            -- Calls answered from the shared snapshot instead
+    pids_visited BIGINT,          -- Processes looked at
+    files_opened BIGINT,          -- procfs files opened
+    bytes_read BIGINT,            -- Bytes consumed by the parsers
+    parse_failures BIGINT,        -- Files or lines that did not parse
+    vanished BIGINT,              -- Processes that exited between listing and reading
+    total_wall_ms FLOAT8,         -- Wall time of all scans
+    total_cpu_ms FLOAT8,          -- CPU time of all scans (scan threads included)
+    mean_wall_ms FLOAT8,          -- Average wall time per scan
+    max_wall_ms FLOAT8,           -- Slowest scan
+    latency_bounds_ms FLOAT8[],   -- Upper bounds of the latency histogram buckets
+    latency_counts BIGINT[],      -- Scans per latency bucket
+    stats_reset TIMESTAMPTZ       -- Last reset of the counters
+);
+
+-- Creating a function to retrieve the cost counters (cluster-wide under shared_preload_libraries)
+CREATE FUNCTION collector_stats()
+RETURNS SETOF collector_stats_type
+LANGUAGE c
+AS '/usr/local/pgsql/lib/pgsyswatch', 'collector_stats';
+
+-- Creating a function to reset the cost counters of one collector, or of all when NULL
+CREATE FUNCTION collector_stats_reset(collector TEXT DEFAULT NULL)
+RETURNS void
+LANGUAGE c
+AS '/usr/local/pgsql/lib/pgsyswatch', 'collector_stats_reset';
+
+-- Resetting the cluster-wide counters is for superusers and the roles they grant it to, like pg_stat_reset()
+REVOKE ALL ON FUNCTION collector_stats_reset(text) FROM PUBLIC;
+
+-- Creating a type for the process exits recorded by the proc events worker
+CREATE TYPE proc_exit_type AS (
+    pid INT4,                     -- Process ID
+    ppid INT4,                    -- Parent process ID
+    command TEXT,                 -- Executable name (comm)
+    exit_status INT4,             -- Exit status, NULL if killed by a signal
+    term_signal INT4,             -- Terminating signal, NULL if it exited
+    utime BIGINT,                 -- User mode time in ticks, dead threads included
+    stime BIGINT,                 -- Kernel mode time in ticks, dead threads included
+    read_bytes BIGINT,            -- Bytes read from storage, NULL if not readable
+    write_bytes BIGINT,           -- Bytes written to storage, NULL if not readable
+    started_at TIMESTAMPTZ,       -- Start of the process
+    exited_at TIMESTAMPTZ,        -- Exit of the process
+    lifetime FLOAT8               -- Seconds between start and exit
+);
+
+-- Creating a function to retrieve the recorded process exits, removing them when drain is true
+CREATE FUNCTION proc_exit_events(drain BOOLEAN DEFAULT false)
+RETURNS SETOF proc_exit_type
+LANGUAGE c
+AS '/usr/local/pgsql/lib/pgsyswatch', 'proc_exit_events';
+
+-- Creating a table for the process exits stored by the collector worker
+CREATE TABLE process_exits (
+    ts TIMESTAMP DEFAULT NOW(), -- Exit of the process
+    pid INT4,                   -- Process ID
+    ppid INT4,                  -- Parent process ID
+    command TEXT,               -- Executable name (comm)
+    exit_status INT4,           -- Exit status, NULL if killed by a signal
+    term_signal INT4,           -- Terminating signal, NULL if it exited
+    utime INT8,                 -- User mode time in ticks
+    stime INT8,                 -- Kernel mode time in ticks
+    read_bytes INT8,            -- Bytes read from storage
+    write_bytes INT8,           -- Bytes written to storage
+    started_at TIMESTAMP,       -- Start of the process
+    lifetime FLOAT8             -- Seconds between start and exit
+);
+
+-- Creating a type for the kernel page cache residency of relation files
+CREATE TYPE relation_os_cache_type AS (
+    relation REGCLASS,            -- Table, index, sequence, TOAST table or materialized view
+    fork TEXT,                    -- main, fsm, vm or init
+    segments INT4,                -- Segment files of the fork
+    size_mb FLOAT8,               -- Size of all segment files
+    scanned_mb FLOAT8,            -- Part checked before pgsyswatch.os_cache_time_budget was spent
+    cached_mb FLOAT8,             -- Part of scanned_mb resident in the page cache
+    cached_pct FLOAT8             -- cached_mb as a percentage of scanned_mb
+);
+
+-- Creating a function to retrieve how much of each relation is in the kernel page cache (all relations when NULL)
+CREATE FUNCTION relation_os_cache(rel REGCLASS DEFAULT NULL)
+RETURNS SETOF relation_os_cache_type
+LANGUAGE c
+AS '/usr/local/pgsql/lib/pgsyswatch', 'relation_os_cache';
+
+-- Page cache residency reveals how other roles use relations they may not read, and the walk is costly
+REVOKE ALL ON FUNCTION relation_os_cache(regclass) FROM PUBLIC;
+
+-- Creating a type for the fields of /proc/meminfo
+CREATE TYPE os_meminfo_type AS (
+    field TEXT,                   -- Field name, e.g. Cached, Dirty, Writeback, AnonHugePages
+    value BIGINT,                 -- Value as reported
+    unit TEXT,                    -- kB, or NULL for counts such as HugePages_Total
+    mb FLOAT8                     -- Value in MB, NULL for counts
+);
+
+-- Creating a function to retrieve every field of /proc/meminfo
+CREATE FUNCTION os_meminfo()
+RETURNS SETOF os_meminfo_type
+LANGUAGE c
+AS '/usr/local/pgsql/lib/pgsyswatch', 'os_meminfo';
+
+-- Creating a type for the memory of server processes per NUMA node
+CREATE TYPE proc_numa_type AS (
+    pid INT4,                     -- Process ID
+    last_cpu INT4,                -- CPU the process last ran on (field 39 of /proc/<pid>/stat)
+    cpu_node INT4,                -- NUMA node of last_cpu
+    node INT4,                    -- NUMA node the memory below is on
+    anon_mb FLOAT8,               -- Private anonymous memory (heap, stack, work_mem)
+    file_mb FLOAT8,               -- Mapped files (binaries, libraries)
+    shmem_mb FLOAT8               -- Shared memory (shared_buffers, DSM segments)
+);
+
+-- Creating a function to retrieve the NUMA placement of one process, or of the postmaster and its children when NULL or 0
+-- max_staleness (ms): NULL uses pgsyswatch.cache_ttl, 0 forces a fresh read
+CREATE FUNCTION proc_numa(pid INTEGER DEFAULT NULL, max_staleness INTEGER DEFAULT NULL)
+RETURNS SETOF proc_numa_type
+LANGUAGE c
+AS '/usr/local/pgsql/lib/pgsyswatch', 'proc_numa';
+
+-- Creating a type for the NUMA nodes
+CREATE TYPE numa_node_type AS (
+    node INT4,                    -- NUMA node
+    cpus TEXT,                    -- CPUs of the node, e.g. 0-15,32-47
+    total_mb FLOAT8,              -- Memory of the node
+    free_mb FLOAT8,               -- Free memory of the node
+    used_mb FLOAT8                -- Used memory of the node
+);
+
+-- Creating a function to retrieve the NUMA nodes from /sys/devices/system/node
+CREATE FUNCTION numa_nodes()
+RETURNS SETOF numa_node_type
+LANGUAGE c
+AS '/usr/local/pgsql/lib/pgsyswatch', 'numa_nodes';
+
+-- Creating a table for the rules of the collector worker's anomaly detection (NULL thresholds are not checked)
+CREATE TABLE alert_rules (
+    metric TEXT PRIMARY KEY CHECK (metric IN ('proc_cpu_pct', 'proc_rss_growth_mb_min', 'proc_io_mb_s',
+                                              'load_per_core', 'swap_used_pct', 'net_errors_per_s')),
+    enabled BOOLEAN NOT NULL DEFAULT true,
+    max_value FLOAT8,                       -- Fires above this value
+    max_zscore FLOAT8,                      -- Fires this many standard deviations above the moving mean
+    min_stddev FLOAT8 NOT NULL DEFAULT 0,   -- Floor of the standard deviation, so a flat metric does not fire on noise
+    clear_ratio FLOAT8 NOT NULL DEFAULT 0.8 CHECK (clear_ratio > 0 AND clear_ratio <= 1), -- Resolves below this share of the threshold
+    alpha FLOAT8 NOT NULL DEFAULT 0.1 CHECK (alpha > 0 AND alpha <= 1),                    -- Weight of the newest sample in the moving mean and variance
+    warmup INT4 NOT NULL DEFAULT 10         -- Samples before z-scores are checked
+);
+
+INSERT INTO alert_rules (metric, max_value, max_zscore, min_stddev) VALUES
+    ('proc_cpu_pct', 90, 4, 5),             -- % of one core, per process
+    ('proc_rss_growth_mb_min', 256, 4, 16), -- MB per minute, per process
+    ('proc_io_mb_s', NULL, 5, 1),           -- MB read and written per second, per process
+    ('load_per_core', 2, 4, 0.1),           -- 1 minute load average per CPU core
+    ('swap_used_pct', 50, NULL, 1),         -- % of swap used
+    ('net_errors_per_s', 10, 5, 1);         -- Receive and transmit errors and drops per second
+
+-- Creating a table for the alerts raised and resolved by the collector worker
+CREATE TABLE alerts (
+    ts TIMESTAMP DEFAULT NOW(), -- Sample the alert changed state in
+    metric TEXT,                -- Metric of alert_rules
+    pid INT4,                   -- Process ID, NULL for host metrics
+    command TEXT,               -- Process name, NULL for host metrics
+    state TEXT,                 -- firing or resolved
+    value FLOAT8,               -- Value of the metric, NULL when resolved because the process exited
+    mean FLOAT8,                -- Moving mean before this sample
+    stddev FLOAT8,              -- Moving standard deviation before this sample
+    zscore FLOAT8               -- Standard deviations above the mean, NULL during warmup
+);
+
+-- Reset search_path back to default
+RESET search_path;
@@ -10,6 +10,10 @@ Copyright 2025 Alexander Scheglov */
 #include "utils/builtins.h"
 #include "funcapi.h"        /*  For SRF (Set Returning Functions) */
 #include "executor/spi.h"   /*  For working with tuples */
+#include "utils/guc.h"      /*  For MarkGUCPrefixReserved */
+#include "miscadmin.h"
+#include "storage/ipc.h"    /*  For the shared memory hooks */
+#include "storage/lwlock.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,8 +23,78 @@ Copyright 2025 Alexander Scheglov */
 
 #include "pgsyswatch_common.h" 
 #include "system_info.h" 
+#include "pgsyswatch_alerts.h"
+#include "pgsyswatch_cache.h"
+#include "pgsyswatch_collector.h"
+#include "pgsyswatch_os_cache.h"
+#include "pgsyswatch_proc_events.h"
+#include "pgsyswatch_spool.h"
+#include "pgsyswatch_stats.h"
 
 PG_MODULE_MAGIC;
+
+void _PG_init(void);
+
+#if PG_VERSION_NUM >= 150000
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+#endif
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+/* Function to reserve the shared memory and locks of every module */
+static void pgsyswatch_shmem_request(void)
+{
+#if PG_VERSION_NUM >= 150000
+    if (prev_shmem_request_hook)
+        prev_shmem_request_hook();
+#endif
+
+    pgsyswatch_cache_shmem_request();
+    pgsyswatch_stats_shmem_request();
+    pgsyswatch_proc_events_shmem_request();
+}
+
+/* Function to attach to (and on first use initialize) the shared state of every module */
+static void pgsyswatch_shmem_startup(void)
+{
+    if (prev_shmem_startup_hook)
+        prev_shmem_startup_hook();
+
+    LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+    pgsyswatch_cache_shmem_startup();
+    pgsyswatch_stats_shmem_startup();
+    pgsyswatch_proc_events_shmem_startup();
+    LWLockRelease(AddinShmemInitLock);
+}
+
+/* Module load callback: defines GUCs and, under shared_preload_libraries, shared state */
+void _PG_init(void)
+{
+    pgsyswatch_common_init();
+    pgsyswatch_cache_init();
+    pgsyswatch_collector_init();
+    pgsyswatch_spool_init();
+    pgsyswatch_proc_events_init();
+    pgsyswatch_os_cache_init();
+    pgsyswatch_alerts_init();
+
+    if (process_shared_preload_libraries_in_progress) {
+#if PG_VERSION_NUM >= 150000
+        prev_shmem_request_hook = shmem_request_hook;
+        shmem_request_hook = pgsyswatch_shmem_request;
+#else
+        pgsyswatch_shmem_request();
+#endif
+        prev_shmem_startup_hook = shmem_startup_hook;
+        shmem_startup_hook = pgsyswatch_shmem_startup;
+    }
+
+#if PG_VERSION_NUM >= 150000
+    MarkGUCPrefixReserved("pgsyswatch");
+#else
+    EmitWarningsOnPlaceholders("pgsyswatch");
+#endif
+}
+
 /* Function to retrieve process information by PID */
 PG_FUNCTION_INFO_V1(proc_monitor);
 
@@ -30,7 +104,10 @@ Datum proc_monitor(PG_FUNCTION_ARGS)
     int pid = PG_GETARG_INT32(0);
 
     /* Retrieve process information */
+    CollectorScan scan;
+    pgsyswatch_stats_scan_begin(&scan, PGSYSWATCH_COLLECTOR_PROC_MONITOR);
     ProcessInfo process = get_process_info(pid);
+    pgsyswatch_stats_scan_end(&scan, 1);
 
     /* Define the structure of the returned columns */
     TupleDesc tupdesc = CreateTemplateTupleDesc(14);
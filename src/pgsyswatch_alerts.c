@@ -0,0 +1,543 @@
+/* src/pgsyswatch_alerts.c
+SPDX-License-Identifier: Apache-2.0
+Copyright 2025 Alexander Scheglov */
+#include "postgres.h"
+#include "fmgr.h"
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/timestamp.h"
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pgsyswatch_alerts.h"
+#include "system_info.h"
+
+/*
+ * Streaming anomaly detection.
+ *
+ * The collector worker feeds every sample it reads to the detector, which
+ * keeps an exponentially weighted mean and variance per metric: per
+ * process for CPU, RSS growth and I/O rate, for the host for load, swap
+ * use and network errors. Each update is O(1) and no history table is
+ * read. A metric raises an alert when it crosses the absolute or z-score
+ * threshold of its row in pgsyswatch.alert_rules, and resolves it once it
+ * is back under clear_ratio times that threshold, so that a value
+ * hovering around a threshold does not flap.
+ *
+ * Alerts are logged when detected, then inserted into pgsyswatch.alerts
+ * and sent with pg_notify() in the transaction that stores the sample.
+ * When that transaction fails they are kept for the next one; during
+ * recovery, where neither is possible, the log is all there is.
+ *
+ * Both tables come with version 1.1 of the extension. Until ALTER EXTENSION
+ * pgsyswatch UPDATE creates them, detection is off and the collector
+ * stores its samples as before.
+ */
+
+/* GUC variables */
+char *pgsyswatch_alert_channel = NULL;     /* Empty: no NOTIFY */
+
+/* Metrics the detector follows; per-process ones first */
+typedef enum AlertMetric {
+    ALERT_PROC_CPU_PCT,
+    ALERT_PROC_RSS_GROWTH,
+    ALERT_PROC_IO_RATE,
+    ALERT_LOAD_PER_CORE,
+    ALERT_SWAP_USED_PCT,
+    ALERT_NET_ERROR_RATE,
+    ALERT_NUM_METRICS
+} AlertMetric;
+
+#define ALERT_NUM_PROC_METRICS (ALERT_PROC_IO_RATE + 1)
+
+/* Names in alert_rules.metric, in AlertMetric order */
+static const char *const alert_metric_names[ALERT_NUM_METRICS] = {
+    "proc_cpu_pct",               /* CPU time per wall time, % of one core */
+    "proc_rss_growth_mb_min",     /* Resident memory growth, MB per minute */
+    "proc_io_mb_s",               /* Storage reads and writes, MB per second */
+    "load_per_core",              /* 1 minute load average per CPU core */
+    "swap_used_pct",              /* Used swap, % of total */
+    "net_errors_per_s",           /* Receive and transmit errors and drops per second */
+};
+
+/* One row of alert_rules; thresholds are NaN when not set */
+typedef struct AlertRule {
+    bool enabled;
+    double max_value;
+    double max_zscore;
+    double min_stddev;          /* Floor of the stddev used for z-scores */
+    double clear_ratio;         /* Hysteresis: resolve below clear_ratio * threshold */
+    double alpha;               /* EWMA smoothing factor */
+    int warmup;                 /* Samples before z-scores are trusted */
+} AlertRule;
+
+/* Streaming statistics of one metric of one process or of the host */
+typedef struct AlertStat {
+    double mean;
+    double var;
+    int64 n;
+    bool firing;
+} AlertStat;
+
+typedef struct AlertProcess {
+    int pid;                    /* Hash key */
+    uint64 seen;                /* Last sample the process was in */
+    TimestampTz sampled_at;
+    double cpu_ticks;           /* utime + stime at sampled_at */
+    double res_mb;
+    double io_bytes;            /* read_bytes + write_bytes */
+    char command[64];
+    AlertStat stats[ALERT_NUM_PROC_METRICS];
+} AlertProcess;
+
+typedef struct AlertHost {
+    TimestampTz sampled_at;     /* 0 before the first sample */
+    double net_errors;
+    AlertStat stats[ALERT_NUM_METRICS];
+} AlertHost;
+
+/* An alert raised or resolved, waiting to be stored */
+typedef struct AlertEvent {
+    AlertMetric metric;
+    int pid;                    /* 0 for host metrics */
+    char command[64];
+    bool firing;
+    double value;               /* NaN once the process is gone */
+    double mean;
+    double stddev;
+    double zscore;              /* NaN when not defined */
+} AlertEvent;
+
+/* Alerts kept while they cannot be stored; more are only logged */
+#define ALERT_MAX_PENDING 1024
+
+static AlertRule alert_rules[ALERT_NUM_METRICS];
+static HTAB *alert_processes = NULL;
+static AlertHost alert_host;
+static uint64 alert_samples = 0;
+static AlertEvent alert_pending[ALERT_MAX_PENDING];
+static int alert_npending = 0;
+static bool alert_active = false;       /* alert_rules and alerts exist */
+
+/* Function to define the alert GUCs */
+void pgsyswatch_alerts_init(void) {
+    DefineCustomStringVariable("pgsyswatch.alert_channel",
+                               "NOTIFY channel the collector worker sends alerts on.",
+                               "Empty disables the notifications; alerts are still stored.",
+                               &pgsyswatch_alert_channel,
+                               "pgsyswatch_alerts",
+                               PGC_SIGHUP,
+                               0,
+                               NULL, NULL, NULL);
+}
+
+/* Function to read a float8 column of alert_rules, NaN for NULL */
+static double alert_rule_value(HeapTuple tuple, TupleDesc tupdesc, int column) {
+    bool isnull;
+    Datum value = SPI_getbinval(tuple, tupdesc, column, &isnull);
+
+    return isnull ? NAN : DatumGetFloat8(value);
+}
+
+/* Function to check whether the alert tables exist */
+static bool alert_tables_exist(void) {
+    bool isnull;
+    bool exist;
+    int ret;
+
+    ret = SPI_execute("SELECT pg_catalog.to_regclass('pgsyswatch.alert_rules') IS NOT NULL "
+                      "AND pg_catalog.to_regclass('pgsyswatch.alerts') IS NOT NULL", true, 1);
+    if (ret != SPI_OK_SELECT || SPI_processed != 1) {
+        elog(ERROR, "pgsyswatch alerts: table lookup failed: %s", SPI_result_code_string(ret));
+    }
+    exist = DatumGetBool(SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1, &isnull));
+    SPI_freetuptable(SPI_tuptable);
+
+    return exist;
+}
+
+/* Function to read the rules; metrics without a row are not alerted on */
+void pgsyswatch_alerts_load_rules(void) {
+    static bool warned_missing = false;
+    int ret;
+    uint64 i;
+    int m;
+
+    for (m = 0; m < ALERT_NUM_METRICS; m++) {
+        alert_rules[m].enabled = false;
+        alert_rules[m].alpha = 0.1;
+    }
+
+    alert_active = alert_tables_exist();
+    if (!alert_active) {
+        if (!warned_missing) {
+            ereport(LOG,
+                    (errmsg("pgsyswatch alerts: tables alert_rules and alerts do not exist, skipping anomaly detection until ALTER EXTENSION pgsyswatch UPDATE")));
+            warned_missing = true;
+        }
+        alert_npending = 0;
+        return;
+    }
+    warned_missing = false;
+
+    ret = SPI_execute("SELECT metric, enabled, max_value, max_zscore, min_stddev, clear_ratio, alpha, warmup "
+                      "FROM pgsyswatch.alert_rules", true, 0);
+    if (ret != SPI_OK_SELECT) {
+        elog(ERROR, "pgsyswatch alerts: rule lookup failed: %s", SPI_result_code_string(ret));
+    }
+
+    for (i = 0; i < SPI_processed; i++) {
+        HeapTuple tuple = SPI_tuptable->vals[i];
+        TupleDesc tupdesc = SPI_tuptable->tupdesc;
+        char *metric = SPI_getvalue(tuple, tupdesc, 1);
+        AlertRule *rule = NULL;
+        bool isnull;
+
+        for (m = 0; m < ALERT_NUM_METRICS; m++) {
+            if (metric != NULL && strcmp(metric, alert_metric_names[m]) == 0) {
+                rule = &alert_rules[m];
+            }
+        }
+        if (rule == NULL)
+            continue;
+
+        rule->enabled = DatumGetBool(SPI_getbinval(tuple, tupdesc, 2, &isnull)) && !isnull;
+        rule->max_value = alert_rule_value(tuple, tupdesc, 3);
+        rule->max_zscore = alert_rule_value(tuple, tupdesc, 4);
+        rule->min_stddev = alert_rule_value(tuple, tupdesc, 5);
+        rule->clear_ratio = alert_rule_value(tuple, tupdesc, 6);
+        rule->alpha = alert_rule_value(tuple, tupdesc, 7);
+        rule->warmup = DatumGetInt32(SPI_getbinval(tuple, tupdesc, 8, &isnull));
+        if (isnull) {
+            rule->warmup = 0;
+        }
+        if (isnan(rule->min_stddev)) {
+            rule->min_stddev = 0;
+        }
+        if (isnan(rule->clear_ratio)) {
+            rule->clear_ratio = 1;
+        }
+        if (isnan(rule->alpha) || rule->alpha <= 0 || rule->alpha > 1) {
+            rule->alpha = 0.1;
+        }
+    }
+    SPI_freetuptable(SPI_tuptable);
+}
+
+/* Function to log an alert and queue it to be stored */
+static void alert_raise(AlertMetric metric, int pid, const char *command, bool firing,
+                        double value, const AlertStat *stat, double stddev, double zscore) {
+    AlertEvent *event;
+
+    if (pid != 0) {
+        ereport(LOG,
+                (errmsg("pgsyswatch alert %s: %s of process %d (%s) is %g, mean %g, z-score %g",
+                        firing ? "firing" : "resolved", alert_metric_names[metric], pid, command,
+                        value, stat->mean, zscore)));
+    } else {
+        ereport(LOG,
+                (errmsg("pgsyswatch alert %s: %s is %g, mean %g, z-score %g",
+                        firing ? "firing" : "resolved", alert_metric_names[metric],
+                        value, stat->mean, zscore)));
+    }
+
+    if (alert_npending == ALERT_MAX_PENDING)
+        return;
+
+    event = &alert_pending[alert_npending++];
+    event->metric = metric;
+    event->pid = pid;
+    strlcpy(event->command, command != NULL ? command : "", sizeof(event->command));
+    event->firing = firing;
+    event->value = value;
+    event->mean = stat->mean;
+    event->stddev = stddev;
+    event->zscore = zscore;
+}
+
+/* Function to check one observation against its rule, then fold it into the statistics */
+static void alert_observe(AlertMetric metric, AlertStat *stat, double value, int pid, const char *command) {
+    AlertRule *rule = &alert_rules[metric];
+    double stddev = sqrt(stat->var);
+    double zscore = NAN;
+    double diff;
+    double increment;
+
+    if (rule->enabled) {
+        bool over;
+        bool clear;
+
+        /* Judged against the statistics before this observation, so that a spike cannot hide itself */
+        if (stat->n >= Max(rule->warmup, 1)) {
+            zscore = (value - stat->mean) / Max(stddev, Max(rule->min_stddev, 1e-9));
+        }
+
+        over = (!isnan(rule->max_value) && value > rule->max_value) ||
+               (!isnan(rule->max_zscore) && !isnan(zscore) && zscore > rule->max_zscore);
+        clear = (isnan(rule->max_value) || value < rule->max_value * rule->clear_ratio) &&
+                (isnan(rule->max_zscore) || isnan(zscore) || zscore < rule->max_zscore * rule->clear_ratio);
+
+        if (!stat->firing && over) {
+            stat->firing = true;
+            alert_raise(metric, pid, command, true, value, stat, stddev, zscore);
+        } else if (stat->firing && clear) {
+            stat->firing = false;
+            alert_raise(metric, pid, command, false, value, stat, stddev, zscore);
+        }
+    } else {
+        /* A rule switched off leaves nothing firing behind */
+        stat->firing = false;
+    }
+
+    /* Exponentially weighted mean and variance */
+    if (stat->n == 0) {
+        stat->mean = value;
+        stat->var = 0;
+    } else {
+        diff = value - stat->mean;
+        increment = rule->alpha * diff;
+        stat->mean += increment;
+        stat->var = (1 - rule->alpha) * (stat->var + diff * increment);
+    }
+    stat->n++;
+}
+
+/* Function to read a numeric column of a sample row as a double */
+static double alert_column(HeapTuple tuple, TupleDesc tupdesc, int column, bool *isnull) {
+    Datum value = SPI_getbinval(tuple, tupdesc, column, isnull);
+
+    if (*isnull)
+        return 0;
+
+    switch (SPI_gettypeid(tupdesc, column)) {
+    case INT4OID:
+        return DatumGetInt32(value);
+    case INT8OID:
+        return (double) DatumGetInt64(value);
+    case FLOAT4OID:
+        return DatumGetFloat4(value);
+    case FLOAT8OID:
+        return DatumGetFloat8(value);
+    default:
+        elog(ERROR, "pgsyswatch alerts: column %d of the sample is not numeric", column);
+    }
+    return 0;
+}
+
+/* Function to find a column of a sample by name */
+static int alert_column_number(TupleDesc tupdesc, const char *name) {
+    int column = SPI_fnumber(tupdesc, name);
+
+    if (column <= 0) {
+        elog(ERROR, "pgsyswatch alerts: sample has no column \"%s\"", name);
+    }
+    return column;
+}
+
+/* Function to resolve the alerts firing for a process that is gone */
+static void alert_resolve_process(AlertProcess *entry) {
+    int m;
+
+    for (m = 0; m < ALERT_NUM_PROC_METRICS; m++) {
+        if (entry->stats[m].firing) {
+            entry->stats[m].firing = false;
+            alert_raise((AlertMetric) m, entry->pid, entry->command, false, NAN,
+                        &entry->stats[m], sqrt(entry->stats[m].var), NAN);
+        }
+    }
+}
+
+/* Function to follow the per-process metrics of a proc_activity_snapshots sample */
+static void alert_observe_processes(SPITupleTable *tuptable, uint64 ntuples, TimestampTz now) {
+    static long clock_ticks = 0;
+    TupleDesc tupdesc = tuptable->tupdesc;
+    int pid_column = alert_column_number(tupdesc, "pid");
+    int command_column = alert_column_number(tupdesc, "command");
+    int res_column = alert_column_number(tupdesc, "res_mb");
+    int cpu_column = alert_column_number(tupdesc, "cpu_ticks");
+    int read_column = alert_column_number(tupdesc, "read_bytes");
+    int write_column = alert_column_number(tupdesc, "write_bytes");
+    HASH_SEQ_STATUS status;
+    AlertProcess *entry;
+    uint64 i;
+
+    if (clock_ticks == 0) {
+        clock_ticks = sysconf(_SC_CLK_TCK);
+    }
+    if (alert_processes == NULL) {
+        HASHCTL ctl;
+
+        memset(&ctl, 0, sizeof(ctl));
+        ctl.keysize = sizeof(int);
+        ctl.entrysize = sizeof(AlertProcess);
+        alert_processes = hash_create("pgsyswatch alert processes", 1024, &ctl, HASH_ELEM | HASH_BLOBS);
+    }
+
+    for (i = 0; i < ntuples; i++) {
+        HeapTuple tuple = tuptable->vals[i];
+        bool isnull;
+        bool found;
+        int pid = (int) alert_column(tuple, tupdesc, pid_column, &isnull);
+        char *command;
+        double cpu_ticks;
+        double res_mb;
+        double io_bytes;
+        bool any_null;
+
+        if (isnull)
+            continue;
+        cpu_ticks = alert_column(tuple, tupdesc, cpu_column, &any_null);
+        res_mb = alert_column(tuple, tupdesc, res_column, &isnull);
+        any_null |= isnull;
+        io_bytes = alert_column(tuple, tupdesc, read_column, &isnull);
+        any_null |= isnull;
+        io_bytes += alert_column(tuple, tupdesc, write_column, &isnull);
+        any_null |= isnull;
+        if (any_null)
+            continue;
+
+        entry = (AlertProcess *) hash_search(alert_processes, &pid, HASH_ENTER, &found);
+
+        /* Counters going backwards mean the PID was reused: resolve what the old process had firing, start over */
+        if (found && (cpu_ticks < entry->cpu_ticks || io_bytes < entry->io_bytes)) {
+            alert_resolve_process(entry);
+            found = false;
+        }
+        command = SPI_getvalue(tuple, tupdesc, command_column);
+        strlcpy(entry->command, command != NULL ? command : "", sizeof(entry->command));
+        if (!found) {
+            memset(entry->stats, 0, sizeof(entry->stats));
+        } else if (now > entry->sampled_at) {
+            double seconds = (now - entry->sampled_at) / 1000000.0;
+
+            alert_observe(ALERT_PROC_CPU_PCT, &entry->stats[ALERT_PROC_CPU_PCT],
+                          (cpu_ticks - entry->cpu_ticks) / clock_ticks / seconds * 100, pid, entry->command);
+            alert_observe(ALERT_PROC_RSS_GROWTH, &entry->stats[ALERT_PROC_RSS_GROWTH],
+                          (res_mb - entry->res_mb) / seconds * 60, pid, entry->command);
+            alert_observe(ALERT_PROC_IO_RATE, &entry->stats[ALERT_PROC_IO_RATE],
+                          (io_bytes - entry->io_bytes) / seconds / (1024 * 1024), pid, entry->command);
+        }
+
+        entry->seen = alert_samples;
+        entry->sampled_at = now;
+        entry->cpu_ticks = cpu_ticks;
+        entry->res_mb = res_mb;
+        entry->io_bytes = io_bytes;
+    }
+
+    /* Forget processes that exited, resolving what they had firing */
+    hash_seq_init(&status, alert_processes);
+    while ((entry = (AlertProcess *) hash_seq_search(&status)) != NULL) {
+        if (entry->seen == alert_samples)
+            continue;
+        alert_resolve_process(entry);
+        hash_search(alert_processes, &entry->pid, HASH_REMOVE, NULL);
+    }
+}
+
+/* Function to follow the host metrics of a net_and_loadavg_snapshots sample */
+static void alert_observe_host(SPITupleTable *tuptable, uint64 ntuples, TimestampTz now) {
+    TupleDesc tupdesc = tuptable->tupdesc;
+    static const char *const error_columns[] = {
+        "total_receive_errs", "total_receive_drop", "total_transmit_errs", "total_transmit_drop",
+    };
+    SystemSwapInfo swap;
+    HeapTuple tuple;
+    double load1;
+    double cores;
+    double net_errors = 0;
+    bool isnull;
+    int c;
+
+    if (ntuples == 0)
+        return;
+    tuple = tuptable->vals[0];
+
+    load1 = alert_column(tuple, tupdesc, alert_column_number(tupdesc, "load1"), &isnull);
+    cores = alert_column(tuple, tupdesc, alert_column_number(tupdesc, "cpu_cores"), &isnull);
+    if (!isnull && cores > 0) {
+        alert_observe(ALERT_LOAD_PER_CORE, &alert_host.stats[ALERT_LOAD_PER_CORE], load1 / cores, 0, NULL);
+    }
+
+    /* Swap is not part of the sample; one read of /proc/meminfo */
+    swap = get_system_swap_info();
+    if (swap.total_swap > 0) {
+        alert_observe(ALERT_SWAP_USED_PCT, &alert_host.stats[ALERT_SWAP_USED_PCT],
+                      swap.used_swap / swap.total_swap * 100, 0, NULL);
+    }
+
+    for (c = 0; c < lengthof(error_columns); c++) {
+        net_errors += alert_column(tuple, tupdesc, alert_column_number(tupdesc, error_columns[c]), &isnull);
+    }
+    if (alert_host.sampled_at != 0 && now > alert_host.sampled_at && net_errors >= alert_host.net_errors) {
+        alert_observe(ALERT_NET_ERROR_RATE, &alert_host.stats[ALERT_NET_ERROR_RATE],
+                      (net_errors - alert_host.net_errors) / ((now - alert_host.sampled_at) / 1000000.0), 0, NULL);
+    }
+    alert_host.sampled_at = now;
+    alert_host.net_errors = net_errors;
+}
+
+/* Function to feed the rows of one sample table to the detector */
+void pgsyswatch_alerts_observe(const char *table, SPITupleTable *tuptable, uint64 ntuples) {
+    TimestampTz now;
+
+    if (!alert_active)
+        return;
+
+    now = GetCurrentTimestamp();
+    if (strcmp(table, "pgsyswatch.proc_activity_snapshots") == 0) {
+        alert_samples++;
+        alert_observe_processes(tuptable, ntuples, now);
+    } else if (strcmp(table, "pgsyswatch.net_and_loadavg_snapshots") == 0) {
+        alert_observe_host(tuptable, ntuples, now);
+    }
+}
+
+/* Function to store and announce the pending alerts */
+void pgsyswatch_alerts_emit(void) {
+    static const char insert_sql[] =
+        "WITH a AS (INSERT INTO pgsyswatch.alerts (metric, pid, command, state, value, mean, stddev, zscore) "
+        "VALUES ($1, $2, $3, $4, $5, $6, $7, $8) RETURNING *) "
+        "SELECT CASE WHEN $9 <> '' THEN pg_catalog.pg_notify($9, pg_catalog.row_to_json(a)::text) END FROM a";
+    Oid argtypes[9] = {TEXTOID, INT4OID, TEXTOID, TEXTOID, FLOAT8OID, FLOAT8OID, FLOAT8OID, FLOAT8OID, TEXTOID};
+    int i;
+
+    if (!alert_active)
+        return;
+
+    for (i = 0; i < alert_npending; i++) {
+        AlertEvent *event = &alert_pending[i];
+        Datum values[9];
+        char nulls[9];
+        int ret;
+
+        memset(nulls, ' ', sizeof(nulls));
+        values[0] = CStringGetTextDatum(alert_metric_names[event->metric]);
+        values[1] = Int32GetDatum(event->pid);
+        nulls[1] = (event->pid == 0) ? 'n' : ' ';
+        values[2] = CStringGetTextDatum(event->command);
+        nulls[2] = (event->pid == 0) ? 'n' : ' ';
+        values[3] = CStringGetTextDatum(event->firing ? "firing" : "resolved");
+        values[4] = Float8GetDatum(event->value);
+        nulls[4] = isnan(event->value) ? 'n' : ' ';
+        values[5] = Float8GetDatum(event->mean);
+        values[6] = Float8GetDatum(event->stddev);
+        values[7] = Float8GetDatum(event->zscore);
+        nulls[7] = isnan(event->zscore) ? 'n' : ' ';
+        values[8] = CStringGetTextDatum(pgsyswatch_alert_channel != NULL ? pgsyswatch_alert_channel : "");
+
+        ret = SPI_execute_with_args(insert_sql, 9, argtypes, values, nulls, false, 0);
+        if (ret != SPI_OK_SELECT) {
+            elog(ERROR, "pgsyswatch alerts: insert failed: %s", SPI_result_code_string(ret));
+        }
+    }
+}
+
+/* Function to forget the pending alerts */
+void pgsyswatch_alerts_clear(void) {
+    alert_npending = 0;
+}
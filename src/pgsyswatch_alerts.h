@@ -0,0 +1,28 @@
+/* pgsyswatch_alerts.h
+SPDX-License-Identifier: Apache-2.0
+Copyright 2025 Alexander Scheglov */
+#ifndef PGSYSWATCH_ALERTS_H
+#define PGSYSWATCH_ALERTS_H
+
+#include "postgres.h"
+#include "executor/spi.h"
+
+/* GUC variables */
+extern char *pgsyswatch_alert_channel;
+
+/* Defines GUCs (called from _PG_init) */
+void pgsyswatch_alerts_init(void);
+
+/* Read pgsyswatch.alert_rules (SPI must be connected); detection is off while the alert tables do not exist */
+void pgsyswatch_alerts_load_rules(void);
+
+/* Feed the rows a sample read for one table to the detector; tables without metrics are ignored */
+void pgsyswatch_alerts_observe(const char *table, SPITupleTable *tuptable, uint64 ntuples);
+
+/* Insert the pending alerts into pgsyswatch.alerts and NOTIFY them (SPI must be connected) */
+void pgsyswatch_alerts_emit(void);
+
+/* Forget the pending alerts, once their transaction committed or when they cannot be stored */
+void pgsyswatch_alerts_clear(void);
+
+#endif  /* PGSYSWATCH_ALERTS_H */
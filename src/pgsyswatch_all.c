@@ -18,6 +18,7 @@ Copyright 2025 Alexander Scheglov */
 #include <unistd.h>      
 
 #include "pgsyswatch_common.h"
+#include "pgsyswatch_cache.h"
 
 /* Function to retrieve information about all processes */
 PG_FUNCTION_INFO_V1(proc_monitor_all);
@@ -55,75 +56,44 @@ Datum proc_monitor_all(PG_FUNCTION_ARGS)
         attinmeta = TupleDescGetAttInMetadata(tupdesc);
         funcctx->attinmeta = attinmeta;
 
-        /* Scan the /proc directory and collect information about all processes */
-        DIR *dir;
-        struct dirent *ent;
-        dir = opendir("/proc");
-        if (dir == NULL) {
-            ereport(ERROR,
-                    (errcode_for_file_access(),
-                     errmsg("could not open directory /proc")));
-        }
+        /* Collect information about all processes, reusing a fresh shared snapshot if any */
+        int nprocs;
+        ProcessInfo *processes = pgsyswatch_cached_processes(pgsyswatch_cache_staleness_arg(fcinfo, 0), &nprocs);
 
-        /* List to store process information */
-        List *processes = NIL;
-
-        while ((ent = readdir(dir)) != NULL) {
-            if (ent->d_type == DT_DIR && atoi(ent->d_name) > 0) {
-                int pid = atoi(ent->d_name);
-
-                /* Retrieve process information */
-                ProcessInfo process = get_process_info(pid);
-
-                /* Store process information */
-                Datum values[14];
-                bool nulls[14] = {false};
-
-                char state_str[2] = {process.state, '\0'};  // Create a string from the state character
-                values[0] = Int32GetDatum(process.pid);
-                values[1] = Float4GetDatum(process.res_mb);
-                values[2] = Float4GetDatum(process.virt_mb);
-                values[3] = Float4GetDatum(process.swap_mb);
-                if (process.command == NULL) {
-                    process.command = strdup("Unknown");
-                }
-                values[4] = CStringGetTextDatum(process.command);
-                values[5] = CStringGetTextDatum(state_str);
-                values[6] = Int64GetDatum(process.utime);
-                values[7] = Int64GetDatum(process.stime);
-                values[8] = Float4GetDatum(process.cpu_usage);
-                values[9] = Int64GetDatum(process.read_bytes);
-                values[10] = Int64GetDatum(process.write_bytes);
-                values[11] = Int32GetDatum(process.voluntary_ctxt_switches);
-                values[12] = Int32GetDatum(process.nonvoluntary_ctxt_switches);
-                values[13] = Int32GetDatum(process.threads);
-
-                /* Free memory allocated for the command string */
-                if (process.command != NULL) {
-                    free(process.command);
-                }
-
-                /* Create a tuple and add it to the list */
-                HeapTuple tuple = heap_form_tuple(tupdesc, values, nulls);
-                processes = lappend(processes, tuple);
-            }
-        }
-
-        closedir(dir);
-
-        /* Save the list of processes in user_fctx */
+        /* Save the array of processes in user_fctx */
         funcctx->user_fctx = processes;
+        funcctx->max_calls = nprocs;
         MemoryContextSwitchTo(oldcontext);
     }
 
     funcctx = SRF_PERCALL_SETUP();
-    List *processes = (List *) funcctx->user_fctx;
+    ProcessInfo *processes = (ProcessInfo *) funcctx->user_fctx;
 
     /* Return processes one by one */
-    if (list_length(processes) > 0) {
-        HeapTuple tuple = (HeapTuple) linitial(processes);
-        processes = list_delete_first(processes);
-        funcctx->user_fctx = processes;
+    if (funcctx->call_cntr < funcctx->max_calls) {
+        ProcessInfo *process = &processes[funcctx->call_cntr];
+
+        Datum values[14];
+        bool nulls[14] = {false};
+
+        char state_str[2] = {process->state, '\0'};  // Create a string from the state character
+        values[0] = Int32GetDatum(process->pid);
+        values[1] = Float4GetDatum(process->res_mb);
+        values[2] = Float4GetDatum(process->virt_mb);
+        values[3] = Float4GetDatum(process->swap_mb);
+        values[4] = CStringGetTextDatum(process->command);
+        values[5] = CStringGetTextDatum(state_str);
+        values[6] = Int64GetDatum(process->utime);
+        values[7] = Int64GetDatum(process->stime);
+        values[8] = Float4GetDatum(process->cpu_usage);
+        values[9] = Int64GetDatum(process->read_bytes);
+        values[10] = Int64GetDatum(process->write_bytes);
+        values[11] = Int32GetDatum(process->voluntary_ctxt_switches);
+        values[12] = Int32GetDatum(process->nonvoluntary_ctxt_switches);
+        values[13] = Int32GetDatum(process->threads);
+
+        /* Create a tuple */
+        HeapTuple tuple = heap_form_tuple(funcctx->attinmeta->tupdesc, values, nulls);
 
         SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
     } else {
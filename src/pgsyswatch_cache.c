@@ -0,0 +1,389 @@
+/* src/pgsyswatch_cache.c
+SPDX-License-Identifier: Apache-2.0
+Copyright 2025 Alexander Scheglov */
+#include "postgres.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "storage/condition_variable.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/guc.h"
+#include "utils/timestamp.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pgsyswatch_cache.h"
+#include "pgsyswatch_stats.h"
+
+/*
+ * Shared snapshot cache.
+ *
+ * Every dashboard panel that selects from pg_proc_activity runs the whole
+ * readdir + get_process_info loop. The cache keeps the result of the last
+ * scan in shared memory so that concurrent callers pay for one /proc walk:
+ * the first caller that finds the snapshot stale marks the slot as being
+ * scanned and rescans, everybody else arriving meanwhile sleeps on the
+ * slot's condition variable and then reads what the scanner published, as
+ * long as it is no older than their max_staleness when they arrived. No
+ * lock is held during the scan, so scanner and waiters stay cancellable.
+ *
+ * The cache only exists when pgsyswatch is in shared_preload_libraries;
+ * otherwise every call scans /proc directly, as before.
+ */
+
+/* GUC variables */
+int pgsyswatch_cache_ttl = 500;               /* ms, 0 disables the cache */
+int pgsyswatch_cache_max_processes = 8192;    /* capacity of the shared process snapshot */
+
+/* A process entry as stored in shared memory */
+typedef struct CachedProcess {
+    ProcessInfo info;                             /* info.command is not used */
+    char command[PGSYSWATCH_CACHE_COMMAND_LEN];   /* Truncated command line */
+} CachedProcess;
+
+/* One cached data source */
+typedef struct CacheSlot {
+    LWLock *data_lock;          /* Protects the fields below and the payload */
+    ConditionVariable scan_done;    /* Broadcast whenever a scan ends, published or not */
+    bool scanning;              /* A backend is rescanning */
+    TimestampTz scanned_at;     /* Start of the last published scan, 0 if none */
+    char proc_root[MAXPGPATH];  /* pgsyswatch.proc_root the snapshot was read from */
+    char sys_root[MAXPGPATH];   /* pgsyswatch.sys_root the snapshot was read from */
+} CacheSlot;
+
+typedef struct PgSysWatchCache {
+    CacheSlot procs;
+    CacheSlot net;
+    CacheSlot loadavg;
+    CacheSlot numa;
+    LoadAvgInfo loadavg_data;
+    int numa_nrows;
+    ProcNumaRow numa_data[PGSYSWATCH_CACHE_NUMA_ROWS];
+    int net_len;
+    char net_data[PGSYSWATCH_CACHE_NET_LEN];
+    int max_processes;
+    int nprocs;
+    CachedProcess procs_data[FLEXIBLE_ARRAY_MEMBER];
+} PgSysWatchCache;
+
+#define PGSYSWATCH_CACHE_NLOCKS 4
+
+static PgSysWatchCache *pgsyswatch_cache = NULL;
+
+/* Function to compute the size of the shared cache */
+static Size pgsyswatch_cache_shmem_size(void) {
+    return add_size(offsetof(PgSysWatchCache, procs_data),
+                    mul_size(pgsyswatch_cache_max_processes, sizeof(CachedProcess)));
+}
+
+/* Function to reserve shared memory and locks for the cache */
+void pgsyswatch_cache_shmem_request(void) {
+    RequestAddinShmemSpace(pgsyswatch_cache_shmem_size());
+    RequestNamedLWLockTranche("pgsyswatch_cache", PGSYSWATCH_CACHE_NLOCKS);
+}
+
+/* Function to attach to (and on first use initialize) the shared cache; AddinShmemInitLock is held */
+void pgsyswatch_cache_shmem_startup(void) {
+    bool found;
+
+    pgsyswatch_cache = ShmemInitStruct("pgsyswatch_cache", pgsyswatch_cache_shmem_size(), &found);
+    if (!found) {
+        LWLockPadded *locks = GetNamedLWLockTranche("pgsyswatch_cache");
+
+        memset(pgsyswatch_cache, 0, offsetof(PgSysWatchCache, procs_data));
+        pgsyswatch_cache->procs.data_lock = &locks[0].lock;
+        pgsyswatch_cache->net.data_lock = &locks[1].lock;
+        pgsyswatch_cache->loadavg.data_lock = &locks[2].lock;
+        pgsyswatch_cache->numa.data_lock = &locks[3].lock;
+        ConditionVariableInit(&pgsyswatch_cache->procs.scan_done);
+        ConditionVariableInit(&pgsyswatch_cache->net.scan_done);
+        ConditionVariableInit(&pgsyswatch_cache->loadavg.scan_done);
+        ConditionVariableInit(&pgsyswatch_cache->numa.scan_done);
+        pgsyswatch_cache->max_processes = pgsyswatch_cache_max_processes;
+    }
+}
+
+/* Function to define the cache GUCs */
+void pgsyswatch_cache_init(void) {
+    DefineCustomIntVariable("pgsyswatch.cache_ttl",
+                            "Maximum age of the shared /proc snapshot served to callers.",
+                            "0 disables the snapshot cache.",
+                            &pgsyswatch_cache_ttl,
+                            500, 0, INT_MAX,
+                            PGC_USERSET,
+                            GUC_UNIT_MS,
+                            NULL, NULL, NULL);
+
+    DefineCustomIntVariable("pgsyswatch.cache_max_processes",
+                            "Number of processes the shared /proc snapshot can hold.",
+                            "Scans that find more processes are returned uncached.",
+                            &pgsyswatch_cache_max_processes,
+                            8192, 0, INT_MAX / 2,
+                            PGC_POSTMASTER,
+                            0,
+                            NULL, NULL, NULL);
+}
+
+/* Function to read a max_staleness argument (NULL falls back to pgsyswatch.cache_ttl) */
+int pgsyswatch_cache_staleness_arg(FunctionCallInfo fcinfo, int argno) {
+    int max_staleness;
+
+    if (PG_NARGS() <= argno || PG_ARGISNULL(argno))
+        return pgsyswatch_cache_ttl;
+
+    max_staleness = PG_GETARG_INT32(argno);
+    if (max_staleness < 0) {
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("max_staleness must not be negative")));
+    }
+    return max_staleness;
+}
+
+/*
+ * Function to check whether the slot holds a snapshot that was at most
+ * max_staleness old at arrived_at (call with data_lock held). A snapshot
+ * read from another proc or sys root is no snapshot at all for this caller.
+ */
+static bool cache_slot_is_fresh(CacheSlot *slot, TimestampTz arrived_at, int max_staleness) {
+    return slot->scanned_at != 0 &&
+           strcmp(slot->proc_root, procfs_root()) == 0 &&
+           strcmp(slot->sys_root, sysfs_root()) == 0 &&
+           !TimestampDifferenceExceeds(slot->scanned_at, arrived_at, max_staleness);
+}
+
+/*
+ * Function to decide whether the caller has to rescan.
+ *
+ * Returns true with the slot marked as being scanned when the caller must
+ * scan, publish if it can, and call cache_slot_end_scan(); false when the
+ * published snapshot can be served as is. Freshness is judged against the
+ * time of the call, so a waiter takes a scan that started while it waited,
+ * but not one that was already too old: when the scanner it waited for did
+ * not publish (too many processes, too much data), it scans itself.
+ */
+static bool cache_slot_begin_scan(CacheSlot *slot, int max_staleness) {
+    TimestampTz arrived_at = GetCurrentTimestamp();
+    bool scan = false;
+
+    for (;;) {
+        LWLockAcquire(slot->data_lock, LW_EXCLUSIVE);
+        if (cache_slot_is_fresh(slot, arrived_at, max_staleness)) {
+            LWLockRelease(slot->data_lock);
+            break;
+        }
+        if (!slot->scanning) {
+            slot->scanning = true;
+            LWLockRelease(slot->data_lock);
+            scan = true;
+            break;
+        }
+        LWLockRelease(slot->data_lock);
+
+        /* Interruptible: a cancelled waiter leaves through CHECK_FOR_INTERRUPTS() */
+        ConditionVariableSleep(&slot->scan_done, PG_WAIT_EXTENSION);
+    }
+    ConditionVariableCancelSleep();
+
+    return scan;
+}
+
+/* Function to end a scan, published or not, and wake the waiters */
+static void cache_slot_end_scan(CacheSlot *slot) {
+    LWLockAcquire(slot->data_lock, LW_EXCLUSIVE);
+    slot->scanning = false;
+    LWLockRelease(slot->data_lock);
+    ConditionVariableBroadcast(&slot->scan_done);
+}
+
+/* Function to end the scan of a backend that errored out or exits in the middle of it */
+static void cache_slot_abort_scan(int code, Datum arg) {
+    cache_slot_end_scan((CacheSlot *) DatumGetPointer(arg));
+}
+
+/* Function to stamp a slot as just published (call with data_lock held exclusively) */
+static void cache_slot_stamp(CacheSlot *slot, TimestampTz started_at) {
+    slot->scanned_at = started_at;
+    strlcpy(slot->proc_root, procfs_root(), sizeof(slot->proc_root));
+    strlcpy(slot->sys_root, sysfs_root(), sizeof(slot->sys_root));
+}
+
+/* Function to check whether callers should go through the shared cache */
+static bool cache_enabled(int max_staleness) {
+    return pgsyswatch_cache != NULL && pgsyswatch_cache_ttl > 0 && max_staleness > 0;
+}
+
+/* Function to return all processes, from the shared snapshot when it is fresh enough */
+ProcessInfo *pgsyswatch_cached_processes(int max_staleness, int *nprocs) {
+    CacheSlot *slot;
+    ProcessInfo *processes;
+    int i;
+
+    if (!cache_enabled(max_staleness))
+        return collect_all_processes(nprocs);
+
+    slot = &pgsyswatch_cache->procs;
+    if (cache_slot_begin_scan(slot, max_staleness)) {
+        TimestampTz started_at = GetCurrentTimestamp();
+
+        PG_ENSURE_ERROR_CLEANUP(cache_slot_abort_scan, PointerGetDatum(slot));
+        {
+            processes = collect_all_processes(nprocs);
+
+            if (*nprocs <= pgsyswatch_cache->max_processes) {
+                LWLockAcquire(slot->data_lock, LW_EXCLUSIVE);
+                for (i = 0; i < *nprocs; i++) {
+                    CachedProcess *entry = &pgsyswatch_cache->procs_data[i];
+
+                    entry->info = processes[i];
+                    entry->info.command = NULL;
+                    strlcpy(entry->command, processes[i].command, sizeof(entry->command));
+                }
+                pgsyswatch_cache->nprocs = *nprocs;
+                cache_slot_stamp(slot, started_at);
+                LWLockRelease(slot->data_lock);
+            } else {
+                elog(DEBUG1, "pgsyswatch: %d processes exceed pgsyswatch.cache_max_processes (%d), snapshot not cached",
+                     *nprocs, pgsyswatch_cache->max_processes);
+            }
+        }
+        PG_END_ENSURE_ERROR_CLEANUP(cache_slot_abort_scan, PointerGetDatum(slot));
+        cache_slot_end_scan(slot);
+
+        return processes;
+    }
+
+    pgsyswatch_stats_cache_hit(PGSYSWATCH_COLLECTOR_PROC_MONITOR_ALL);
+    LWLockAcquire(slot->data_lock, LW_SHARED);
+    *nprocs = pgsyswatch_cache->nprocs;
+    processes = (ProcessInfo *) palloc(Max(*nprocs, 1) * sizeof(ProcessInfo));
+    for (i = 0; i < *nprocs; i++) {
+        CachedProcess *entry = &pgsyswatch_cache->procs_data[i];
+
+        processes[i] = entry->info;
+        processes[i].command = pstrdup(entry->command);
+    }
+    LWLockRelease(slot->data_lock);
+
+    return processes;
+}
+
+/* Function to return the interface lines of /proc/net/dev, from the shared snapshot when possible */
+char *pgsyswatch_cached_net_dev(int max_staleness) {
+    CacheSlot *slot;
+    char *data;
+
+    if (!cache_enabled(max_staleness))
+        return read_net_dev();
+
+    slot = &pgsyswatch_cache->net;
+    if (cache_slot_begin_scan(slot, max_staleness)) {
+        TimestampTz started_at = GetCurrentTimestamp();
+
+        PG_ENSURE_ERROR_CLEANUP(cache_slot_abort_scan, PointerGetDatum(slot));
+        {
+            int len;
+
+            data = read_net_dev();
+            len = strlen(data);
+
+            if (len < PGSYSWATCH_CACHE_NET_LEN) {
+                LWLockAcquire(slot->data_lock, LW_EXCLUSIVE);
+                memcpy(pgsyswatch_cache->net_data, data, len + 1);
+                pgsyswatch_cache->net_len = len;
+                cache_slot_stamp(slot, started_at);
+                LWLockRelease(slot->data_lock);
+            }
+        }
+        PG_END_ENSURE_ERROR_CLEANUP(cache_slot_abort_scan, PointerGetDatum(slot));
+        cache_slot_end_scan(slot);
+
+        return data;
+    }
+
+    pgsyswatch_stats_cache_hit(PGSYSWATCH_COLLECTOR_NET_MONITOR);
+    LWLockAcquire(slot->data_lock, LW_SHARED);
+    data = pnstrdup(pgsyswatch_cache->net_data, pgsyswatch_cache->net_len);
+    LWLockRelease(slot->data_lock);
+
+    return data;
+}
+
+/* Function to return the load average, from the shared snapshot when possible */
+LoadAvgInfo pgsyswatch_cached_loadavg(int max_staleness) {
+    CacheSlot *slot;
+    LoadAvgInfo info;
+
+    if (!cache_enabled(max_staleness))
+        return get_loadavg_info();
+
+    slot = &pgsyswatch_cache->loadavg;
+    if (cache_slot_begin_scan(slot, max_staleness)) {
+        TimestampTz started_at = GetCurrentTimestamp();
+
+        PG_ENSURE_ERROR_CLEANUP(cache_slot_abort_scan, PointerGetDatum(slot));
+        {
+            info = get_loadavg_info();
+
+            LWLockAcquire(slot->data_lock, LW_EXCLUSIVE);
+            pgsyswatch_cache->loadavg_data = info;
+            cache_slot_stamp(slot, started_at);
+            LWLockRelease(slot->data_lock);
+        }
+        PG_END_ENSURE_ERROR_CLEANUP(cache_slot_abort_scan, PointerGetDatum(slot));
+        cache_slot_end_scan(slot);
+
+        return info;
+    }
+
+    pgsyswatch_stats_cache_hit(PGSYSWATCH_COLLECTOR_LOADAVG);
+    LWLockAcquire(slot->data_lock, LW_SHARED);
+    info = pgsyswatch_cache->loadavg_data;
+    LWLockRelease(slot->data_lock);
+
+    return info;
+}
+
+/* Function to return the NUMA placement of the server processes, from the shared snapshot when possible */
+ProcNumaRow *pgsyswatch_cached_numa(int max_staleness, int *nrows) {
+    CacheSlot *slot;
+    ProcNumaRow *rows;
+
+    if (!cache_enabled(max_staleness))
+        return collect_numa(0, nrows);
+
+    slot = &pgsyswatch_cache->numa;
+    if (cache_slot_begin_scan(slot, max_staleness)) {
+        TimestampTz started_at = GetCurrentTimestamp();
+
+        PG_ENSURE_ERROR_CLEANUP(cache_slot_abort_scan, PointerGetDatum(slot));
+        {
+            rows = collect_numa(0, nrows);
+
+            if (*nrows <= PGSYSWATCH_CACHE_NUMA_ROWS) {
+                LWLockAcquire(slot->data_lock, LW_EXCLUSIVE);
+                memcpy(pgsyswatch_cache->numa_data, rows, *nrows * sizeof(ProcNumaRow));
+                pgsyswatch_cache->numa_nrows = *nrows;
+                cache_slot_stamp(slot, started_at);
+                LWLockRelease(slot->data_lock);
+            }
+        }
+        PG_END_ENSURE_ERROR_CLEANUP(cache_slot_abort_scan, PointerGetDatum(slot));
+        cache_slot_end_scan(slot);
+
+        return rows;
+    }
+
+    pgsyswatch_stats_cache_hit(PGSYSWATCH_COLLECTOR_PROC_NUMA);
+    LWLockAcquire(slot->data_lock, LW_SHARED);
+    *nrows = pgsyswatch_cache->numa_nrows;
+    rows = (ProcNumaRow *) palloc(Max(*nrows, 1) * sizeof(ProcNumaRow));
+    memcpy(rows, pgsyswatch_cache->numa_data, *nrows * sizeof(ProcNumaRow));
+    LWLockRelease(slot->data_lock);
+
+    return rows;
+}
@@ -0,0 +1,41 @@
+/* pgsyswatch_cache.h
+SPDX-License-Identifier: Apache-2.0
+Copyright 2025 Alexander Scheglov */
+#ifndef PGSYSWATCH_CACHE_H
+#define PGSYSWATCH_CACHE_H
+
+#include "pgsyswatch_common.h"
+#include "system_info.h"
+#include "pgsyswatch_numa.h"
+
+/* Longest command line kept in the shared snapshot (including the terminator) */
+#define PGSYSWATCH_CACHE_COMMAND_LEN 256
+/* Size of the shared copy of /proc/net/dev */
+#define PGSYSWATCH_CACHE_NET_LEN 65536
+/* Process/node rows of the shared NUMA snapshot */
+#define PGSYSWATCH_CACHE_NUMA_ROWS 8192
+
+/* GUC variables */
+extern int pgsyswatch_cache_ttl;
+extern int pgsyswatch_cache_max_processes;
+
+/* Defines GUCs (called from _PG_init) */
+void pgsyswatch_cache_init(void);
+
+/* Shared memory request and attach, called from the hooks in pgsyswatch.c */
+void pgsyswatch_cache_shmem_request(void);
+void pgsyswatch_cache_shmem_startup(void);
+
+/*
+ * Read a max_staleness argument: NULL means "use pgsyswatch.cache_ttl",
+ * 0 bypasses the cache and forces a fresh scan.
+ */
+int pgsyswatch_cache_staleness_arg(FunctionCallInfo fcinfo, int argno);
+
+/* Snapshot accessors. All results are palloc'd in the current memory context. */
+ProcessInfo *pgsyswatch_cached_processes(int max_staleness, int *nprocs);
+char *pgsyswatch_cached_net_dev(int max_staleness);
+LoadAvgInfo pgsyswatch_cached_loadavg(int max_staleness);
+ProcNumaRow *pgsyswatch_cached_numa(int max_staleness, int *nrows);
+
+#endif  /* PGSYSWATCH_CACHE_H */
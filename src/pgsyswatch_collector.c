@@ -0,0 +1,514 @@
+/* src/pgsyswatch_collector.c
+SPDX-License-Identifier: Apache-2.0
+Copyright 2025 Alexander Scheglov */
+#include "postgres.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "access/xact.h"
+#include "access/xlog.h"
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "postmaster/bgworker.h"
+#include "postmaster/interrupt.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "tcop/tcopprot.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+#include "utils/snapmgr.h"
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "pgsyswatch_alerts.h"
+#include "pgsyswatch_collector.h"
+#include "pgsyswatch_proc_events.h"
+#include "pgsyswatch_spool.h"
+
+/*
+ * Collector background worker.
+ *
+ * Does in-process what sys_proc_maintenance.sh does from cron: once per
+ * pgsyswatch.collector_interval it inserts a proc_activity_snapshots and a
+ * net_and_loadavg_snapshots sample, plus the process_exits recorded by the
+ * proc events worker since the last tick, and once per day it runs
+ * manage_partitions_maintenance(). Inside this worker proc_monitor_all()
+ * harvests /proc with pgsyswatch.collector_scan_threads threads.
+ *
+ * A sample is read first and then inserted. When the insert fails, or the
+ * server is in recovery (a hot standby can still read) and
+ * pgsyswatch.spool_during_recovery is on, the sample goes to the local
+ * spool instead and is replayed once an insert succeeds again, so that
+ * there are no gaps around a failover or an overload.
+ *
+ * Each sample read also goes through the anomaly detector; the alerts it
+ * raises are stored in the same transaction as the sample.
+ *
+ * The process exits are read without being removed, and acknowledged to
+ * the proc events worker only once the sample is committed or spooled; a
+ * tick that fails leaves them to the next one.
+ */
+
+/* GUC variables */
+char *pgsyswatch_collector_database = NULL;     /* NULL or empty: no collector */
+char *pgsyswatch_collector_user = NULL;         /* NULL: bootstrap superuser */
+int pgsyswatch_collector_interval = 60;         /* s */
+int pgsyswatch_collector_scan_threads = 4;
+
+bool pgsyswatch_am_collector = false;
+
+/*
+ * The SELECT part of sql/import_data.sql, with the sample time and the column
+ * types of the table. cpu_ticks is not stored: it gives the detector the CPU
+ * time unrounded, which the float4 columns are not beyond 2^24 ticks.
+ */
+static const char collector_proc_sql[] =
+    "SELECT now()::timestamp, p.pid, a.datname::text, a.usename::text, a.application_name, a.state,"
+    "    a.query, p.res_mb, p.virt_mb, p.swap_mb, p.command, p.state, p.utime::float4,"
+    "    p.stime::float4, p.cpu_usage, p.read_bytes, p.write_bytes, p.voluntary_ctxt_switches::int8,"
+    "    p.nonvoluntary_ctxt_switches::int8, p.threads, (p.utime + p.stime)::int8 AS cpu_ticks "
+    "FROM pg_stat_activity a "
+    "RIGHT JOIN pgsyswatch.proc_monitor_all() p USING(pid)";
+
+static const SpoolColumn collector_proc_columns[] = {
+    {"ts", SPOOL_TIMESTAMP},
+    {"pid", SPOOL_INT4},
+    {"datname", SPOOL_TEXT},
+    {"usename", SPOOL_TEXT},
+    {"application_name", SPOOL_TEXT},
+    {"state_q", SPOOL_TEXT},
+    {"query", SPOOL_TEXT},
+    {"res_mb", SPOOL_FLOAT4},
+    {"virt_mb", SPOOL_FLOAT4},
+    {"swap_mb", SPOOL_FLOAT4},
+    {"command", SPOOL_TEXT},
+    {"state", SPOOL_TEXT},
+    {"utime", SPOOL_FLOAT4},
+    {"stime", SPOOL_FLOAT4},
+    {"pcpu", SPOOL_FLOAT4},
+    {"read_bytes", SPOOL_INT8},
+    {"write_bytes", SPOOL_INT8},
+    {"voluntary_ctxt_switches", SPOOL_INT8},
+    {"nonvoluntary_ctxt_switches", SPOOL_INT8},
+    {"threads", SPOOL_INT4},
+};
+
+/* The SELECT part of sql/import_net_and_loadavg_snapshots.sql */
+static const char collector_net_sql[] =
+    "SELECT now()::timestamp, load1, load5, load15, running_processes, total_processes, last_pid, cpu_cores,"
+    "    total_receive_kbytes::int8, total_receive_packets::int8, total_receive_errs::int8,"
+    "    total_receive_drop::int8, total_transmit_kbytes::int8, total_transmit_packets::int8,"
+    "    total_transmit_errs::int8, total_transmit_drop::int8 "
+    "FROM pgsyswatch.net_and_loadavg";
+
+static const SpoolColumn collector_net_columns[] = {
+    {"ts", SPOOL_TIMESTAMP},
+    {"load1", SPOOL_FLOAT4},
+    {"load5", SPOOL_FLOAT4},
+    {"load15", SPOOL_FLOAT4},
+    {"running_processes", SPOOL_INT4},
+    {"total_processes", SPOOL_INT4},
+    {"last_pid", SPOOL_INT4},
+    {"cpu_cores", SPOOL_INT4},
+    {"total_receive_kbytes", SPOOL_INT8},
+    {"total_receive_packets", SPOOL_INT8},
+    {"total_receive_errs", SPOOL_INT8},
+    {"total_receive_drop", SPOOL_INT8},
+    {"total_transmit_kbytes", SPOOL_INT8},
+    {"total_transmit_packets", SPOOL_INT8},
+    {"total_transmit_errs", SPOOL_INT8},
+    {"total_transmit_drop", SPOOL_INT8},
+};
+
+/* Reads the exits recorded by the proc events worker (none when it is not running) without removing them */
+static const char collector_exits_sql[] =
+    "SELECT exited_at::timestamp, pid, ppid, command, exit_status, term_signal, utime, stime,"
+    "    read_bytes, write_bytes, started_at::timestamp, lifetime "
+    "FROM pgsyswatch.proc_exit_events(false)";
+
+static const SpoolColumn collector_exits_columns[] = {
+    {"ts", SPOOL_TIMESTAMP},
+    {"pid", SPOOL_INT4},
+    {"ppid", SPOOL_INT4},
+    {"command", SPOOL_TEXT},
+    {"exit_status", SPOOL_INT4},
+    {"term_signal", SPOOL_INT4},
+    {"utime", SPOOL_INT8},
+    {"stime", SPOOL_INT8},
+    {"read_bytes", SPOOL_INT8},
+    {"write_bytes", SPOOL_INT8},
+    {"started_at", SPOOL_TIMESTAMP},
+    {"lifetime", SPOOL_FLOAT8},
+};
+
+/* Index of process_exits in collector_tables */
+#define COLLECTOR_EXITS_TABLE 2
+
+/* Tables a sample is stored in; spooled records refer to them by index, so only ever append */
+static const SpoolTable collector_tables[] = {
+    {"pgsyswatch.proc_activity_snapshots", collector_proc_sql, lengthof(collector_proc_columns), collector_proc_columns},
+    {"pgsyswatch.net_and_loadavg_snapshots", collector_net_sql, lengthof(collector_net_columns), collector_net_columns},
+    {"pgsyswatch.process_exits", collector_exits_sql, lengthof(collector_exits_columns), collector_exits_columns},
+};
+
+/* Function to define GUCs and register the collector worker */
+void pgsyswatch_collector_init(void) {
+    BackgroundWorker worker;
+
+    DefineCustomStringVariable("pgsyswatch.collector_database",
+                               "Database the collector worker stores snapshots in.",
+                               "Empty disables the collector worker.",
+                               &pgsyswatch_collector_database,
+                               "",
+                               PGC_POSTMASTER,
+                               0,
+                               NULL, NULL, NULL);
+
+    DefineCustomStringVariable("pgsyswatch.collector_user",
+                               "Role the collector worker connects as.",
+                               "Empty means the bootstrap superuser.",
+                               &pgsyswatch_collector_user,
+                               "",
+                               PGC_POSTMASTER,
+                               0,
+                               NULL, NULL, NULL);
+
+    DefineCustomIntVariable("pgsyswatch.collector_interval",
+                            "Interval between two snapshots taken by the collector worker.",
+                            NULL,
+                            &pgsyswatch_collector_interval,
+                            60, 1, INT_MAX / 1000,
+                            PGC_SIGHUP,
+                            GUC_UNIT_S,
+                            NULL, NULL, NULL);
+
+    DefineCustomIntVariable("pgsyswatch.collector_scan_threads",
+                            "Number of threads the collector worker uses to read /proc.",
+                            NULL,
+                            &pgsyswatch_collector_scan_threads,
+                            4, 1, 256,
+                            PGC_SIGHUP,
+                            0,
+                            NULL, NULL, NULL);
+
+    if (!process_shared_preload_libraries_in_progress ||
+        pgsyswatch_collector_database == NULL || pgsyswatch_collector_database[0] == '\0')
+        return;
+
+    memset(&worker, 0, sizeof(worker));
+    worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+    worker.bgw_start_time = BgWorkerStart_ConsistentState;
+    worker.bgw_restart_time = 10;
+    snprintf(worker.bgw_library_name, BGW_MAXLEN, "pgsyswatch");
+    snprintf(worker.bgw_function_name, BGW_MAXLEN, "pgsyswatch_collector_main");
+    snprintf(worker.bgw_name, BGW_MAXLEN, "pgsyswatch collector");
+    snprintf(worker.bgw_type, BGW_MAXLEN, "pgsyswatch collector");
+    RegisterBackgroundWorker(&worker);
+}
+
+/* Function to check that the extension is installed in the collector database */
+static bool collector_extension_installed(void) {
+    int ret = SPI_execute("SELECT 1 FROM pg_catalog.pg_extension WHERE extname = 'pgsyswatch'", true, 1);
+
+    if (ret != SPI_OK_SELECT) {
+        elog(ERROR, "pgsyswatch collector: extension lookup failed: %s", SPI_result_code_string(ret));
+    }
+    return SPI_processed > 0;
+}
+
+/* Function to run one statement of a sample and check its result */
+static void collector_execute(const char *sql, int expected) {
+    int ret = SPI_execute(sql, false, 0);
+
+    if (ret != expected) {
+        elog(ERROR, "pgsyswatch collector: \"%s\" failed: %s", sql, SPI_result_code_string(ret));
+    }
+}
+
+/* Function to check that a table exists; those added by a later extension version may not yet */
+static bool collector_table_exists(const char *name) {
+    Oid argtypes[1] = {TEXTOID};
+    Datum values[1];
+    bool isnull;
+    bool exists;
+    int ret;
+
+    values[0] = CStringGetTextDatum(name);
+    ret = SPI_execute_with_args("SELECT pg_catalog.to_regclass($1) IS NOT NULL", 1, argtypes, values, NULL, true, 1);
+    if (ret != SPI_OK_SELECT || SPI_processed != 1) {
+        elog(ERROR, "pgsyswatch collector: lookup of table \"%s\" failed: %s", name, SPI_result_code_string(ret));
+    }
+    exists = DatumGetBool(SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1, &isnull));
+    SPI_freetuptable(SPI_tuptable);
+
+    return exists;
+}
+
+/* Function to check that the collector role may read the exits and store them */
+static bool collector_exits_permitted(void) {
+    bool isnull;
+    bool permitted;
+    int ret;
+
+    ret = SPI_execute("SELECT pg_catalog.has_function_privilege('pgsyswatch.proc_exit_events(boolean)', 'EXECUTE') "
+                      "AND pg_catalog.has_table_privilege('pgsyswatch.process_exits', 'INSERT')", true, 1);
+    if (ret != SPI_OK_SELECT || SPI_processed != 1) {
+        elog(ERROR, "pgsyswatch collector: privilege lookup failed: %s", SPI_result_code_string(ret));
+    }
+    permitted = DatumGetBool(SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1, &isnull));
+    SPI_freetuptable(SPI_tuptable);
+
+    return permitted;
+}
+
+/*
+ * Function to read one sample, encoded as spool records.
+ *
+ * Sets *exits_head to the head of the exit ring the sample holds the exits
+ * up to, or to 0 when it holds none.
+ */
+static void collector_read_sample(StringInfo sample, uint64 *exits_head) {
+    static bool warned_missing[lengthof(collector_tables)];
+    static bool warned_exits_denied = false;
+    int i;
+
+    *exits_head = 0;
+
+    for (i = 0; i < lengthof(collector_tables); i++) {
+        /* Until ALTER EXTENSION pgsyswatch UPDATE, the tables of the newer version are left out */
+        if (!collector_table_exists(collector_tables[i].name)) {
+            if (!warned_missing[i]) {
+                ereport(LOG,
+                        (errmsg("pgsyswatch collector: table %s does not exist, skipping it until ALTER EXTENSION pgsyswatch UPDATE",
+                                collector_tables[i].name)));
+                warned_missing[i] = true;
+            }
+            continue;
+        }
+        warned_missing[i] = false;
+
+        /* A collector role that may not store the exits still stores the rest of the sample */
+        if (i == COLLECTOR_EXITS_TABLE) {
+            if (!collector_exits_permitted()) {
+                if (!warned_exits_denied) {
+                    ereport(WARNING,
+                            (errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+                             errmsg("pgsyswatch collector: role \"%s\" may not read proc_exit_events() or insert into %s, skipping process exits",
+                                    GetUserNameFromId(GetUserId(), false), collector_tables[i].name)));
+                    warned_exits_denied = true;
+                }
+                continue;
+            }
+            warned_exits_denied = false;
+        }
+
+        collector_execute(collector_tables[i].select_sql, SPI_OK_SELECT);
+        pgsyswatch_spool_encode(sample, collector_tables, i, SPI_tuptable, SPI_processed);
+        pgsyswatch_alerts_observe(collector_tables[i].name, SPI_tuptable, SPI_processed);
+        SPI_freetuptable(SPI_tuptable);
+
+        if (i == COLLECTOR_EXITS_TABLE) {
+            *exits_head = pgsyswatch_proc_events_read_head();
+        }
+    }
+}
+
+/* Function to log the error being handled and abort its transaction */
+static void collector_abort(MemoryContext context, const char *what) {
+    ErrorData *edata;
+
+    MemoryContextSwitchTo(context);
+    edata = CopyErrorData();
+    FlushErrorState();
+    AbortCurrentTransaction();
+    pgstat_report_activity(STATE_IDLE, NULL);
+
+    ereport(LOG,
+            (errmsg("pgsyswatch collector: could not %s: %s", what, edata->message)));
+    FreeErrorData(edata);
+}
+
+/*
+ * Function to take one sample (and, once a day, maintain the partitions).
+ *
+ * The sample is stored when possible and spooled otherwise. Returns true if
+ * the partitions were maintained.
+ */
+static bool collector_take_sample(bool maintain_partitions) {
+    static bool warned_missing = false;
+    static bool spooling = false;
+    static bool discarding = false;
+    static StringInfo sample = NULL;
+    MemoryContext context = CurrentMemoryContext;
+    bool in_recovery = RecoveryInProgress();
+    volatile bool installed = false;
+    volatile bool sample_read = false;
+    volatile bool stored = false;
+    volatile uint64 exits_head = 0;
+
+    /* The encoded sample outlives the transaction it was read in, to be spooled if need be */
+    if (sample == NULL) {
+        MemoryContext oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+
+        sample = makeStringInfo();
+        MemoryContextSwitchTo(oldcontext);
+    }
+    resetStringInfo(sample);
+
+    PG_TRY();
+    {
+        SetCurrentStatementStartTimestamp();
+        StartTransactionCommand();
+        SPI_connect();
+        PushActiveSnapshot(GetTransactionSnapshot());
+        pgstat_report_activity(STATE_RUNNING, "pgsyswatch collector: taking sample");
+
+        installed = collector_extension_installed();
+        if (installed) {
+            warned_missing = false;
+            uint64 head;
+
+            pgsyswatch_alerts_load_rules();
+            collector_read_sample(sample, &head);
+            exits_head = head;
+            sample_read = true;
+
+            /* Snapshot tables cannot be written during recovery */
+            if (!in_recovery) {
+                if (maintain_partitions) {
+                    collector_execute("SELECT pgsyswatch.manage_partitions_maintenance()", SPI_OK_SELECT);
+                }
+                pgsyswatch_spool_insert(collector_tables, lengthof(collector_tables), sample->data, sample->len);
+                pgsyswatch_alerts_emit();
+            }
+        } else if (!warned_missing) {
+            ereport(LOG,
+                    (errmsg("pgsyswatch collector: extension pgsyswatch is not installed in database \"%s\", skipping samples",
+                            pgsyswatch_collector_database)));
+            warned_missing = true;
+        }
+
+        SPI_finish();
+        PopActiveSnapshot();
+        CommitTransactionCommand();
+        pgstat_report_stat(false);
+        pgstat_report_activity(STATE_IDLE, NULL);
+
+        stored = installed && !in_recovery;
+    }
+    PG_CATCH();
+    {
+        collector_abort(context, "store sample");
+    }
+    PG_END_TRY();
+
+    /* Alerts that were not stored are retried with the next sample; a standby only logs them */
+    if (stored || in_recovery) {
+        pgsyswatch_alerts_clear();
+    }
+
+    if (!installed)
+        return false;
+
+    if (!stored) {
+        /* A standby that is not meant to take over would only pile up segments that are never replayed; the exits go with the sample */
+        if (in_recovery && !pgsyswatch_spool_during_recovery) {
+            if (sample_read) {
+                pgsyswatch_proc_events_ack(exits_head);
+            }
+            if (!discarding) {
+                ereport(LOG,
+                        (errmsg("pgsyswatch collector: server is in recovery, samples are not stored"),
+                         errhint("Set pgsyswatch.spool_during_recovery to spool them until the server is promoted.")));
+                discarding = true;
+            }
+            return false;
+        }
+        discarding = false;
+
+        /* Only a completely read sample is worth keeping; its exits are read again next tick otherwise */
+        if (sample_read && pgsyswatch_spool_append(collector_tables, lengthof(collector_tables),
+                                                   sample->data, sample->len)) {
+            pgsyswatch_proc_events_ack(exits_head);
+            if (!spooling) {
+                ereport(LOG,
+                        (errmsg("pgsyswatch collector: %s, spooling samples to \"%s\" until they can be stored",
+                                in_recovery ? "server is in recovery" : "insert failed", pgsyswatch_spool_directory)));
+                spooling = true;
+            }
+        }
+        return false;
+    }
+
+    pgsyswatch_proc_events_ack(exits_head);
+    spooling = false;
+    discarding = false;
+    if (pgsyswatch_spool_pending()) {
+        PG_TRY();
+        {
+            uint64 rows = pgsyswatch_spool_replay(collector_tables, lengthof(collector_tables));
+
+            ereport(LOG,
+                    (errmsg("pgsyswatch collector: replayed " UINT64_FORMAT " spooled rows", rows)));
+        }
+        PG_CATCH();
+        {
+            collector_abort(context, "replay spool");
+        }
+        PG_END_TRY();
+    }
+
+    return maintain_partitions;
+}
+
+/* Function to get the current local day, to run partition maintenance once per day */
+static int collector_current_day(void) {
+    time_t now = time(NULL);
+    struct tm tm;
+
+    localtime_r(&now, &tm);
+    return tm.tm_year * 1000 + tm.tm_yday;
+}
+
+/* Entry point of the collector background worker */
+void pgsyswatch_collector_main(Datum main_arg) {
+    int maintained_day = -1;
+    int today;
+
+    pqsignal(SIGHUP, SignalHandlerForConfigReload);
+    pqsignal(SIGTERM, die);
+    BackgroundWorkerUnblockSignals();
+
+    BackgroundWorkerInitializeConnection(pgsyswatch_collector_database,
+                                         pgsyswatch_collector_user[0] != '\0' ? pgsyswatch_collector_user : NULL,
+                                         0);
+    pgsyswatch_am_collector = true;
+
+    ereport(LOG,
+            (errmsg("pgsyswatch collector started: database \"%s\", interval %d s, %d scan threads",
+                    pgsyswatch_collector_database, pgsyswatch_collector_interval,
+                    pgsyswatch_collector_scan_threads)));
+
+    for (;;) {
+        CHECK_FOR_INTERRUPTS();
+
+        if (ConfigReloadPending) {
+            ConfigReloadPending = false;
+            ProcessConfigFile(PGC_SIGHUP);
+        }
+
+        today = collector_current_day();
+        if (collector_take_sample(today != maintained_day)) {
+            maintained_day = today;
+        }
+
+        (void) WaitLatch(MyLatch,
+                         WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+                         pgsyswatch_collector_interval * 1000L,
+                         PG_WAIT_EXTENSION);
+        ResetLatch(MyLatch);
+    }
+}
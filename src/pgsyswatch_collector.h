@@ -0,0 +1,25 @@
+/* pgsyswatch_collector.h
+SPDX-License-Identifier: Apache-2.0
+Copyright 2025 Alexander Scheglov */
+#ifndef PGSYSWATCH_COLLECTOR_H
+#define PGSYSWATCH_COLLECTOR_H
+
+#include "postgres.h"
+#include "fmgr.h"
+
+/* GUC variables */
+extern char *pgsyswatch_collector_database;
+extern char *pgsyswatch_collector_user;
+extern int pgsyswatch_collector_interval;
+extern int pgsyswatch_collector_scan_threads;
+
+/* True inside the collector background worker */
+extern bool pgsyswatch_am_collector;
+
+/* Defines GUCs and registers the background worker (called from _PG_init) */
+void pgsyswatch_collector_init(void);
+
+/* Entry point of the background worker */
+PGDLLEXPORT void pgsyswatch_collector_main(Datum main_arg) pg_attribute_noreturn();
+
+#endif  /* PGSYSWATCH_COLLECTOR_H */
@@ -20,25 +20,16 @@ Copyright 2025 Alexander Scheglov */
 #include <sys/time.h>
 #include <unistd.h>
 
-/* Define a structure to store process information */
-typedef struct {
-    int pid;                        /* Process ID */
-    char *command;                  /* Command that started the process */
-    char state;                     /* Process state (single letter: R, S, D, Z, etc.) */
-    float res_mb;                   /* Resident memory usage in MB */
-    float virt_mb;                  /* Virtual memory usage in MB */
-    float swap_mb;                  /* Swap usage in MB */
-    unsigned long long utime;       /* Time spent in user mode */
-    unsigned long long stime;       /* Time spent in system mode */
-    float cpu_usage;                /* CPU usage percentage */
-    unsigned long read_bytes;       /* Number of bytes read from disk */
-    unsigned long write_bytes;      /* Number of bytes written to disk */
-    int voluntary_ctxt_switches;    /* Number of voluntary context switches */
-    int nonvoluntary_ctxt_switches; /* Number of involuntary context switches */
-    int threads;                    /* Number of threads */
-} ProcessInfo;
+#include "pgsyswatch_procfs.h"
 
-/* Declare the function get_process_info */
-ProcessInfo get_process_info(int pid);
+/* Defines the GUCs shared by all collectors (called from _PG_init) */
+void pgsyswatch_common_init(void);
+
+/* Scan /proc and return a palloc'd array with one entry per process.
+ * Command strings are palloc'd as well. */
+ProcessInfo *collect_all_processes(int *nprocs);
+
+/* Read the interface lines of /proc/net/dev into a palloc'd string */
+char *read_net_dev(void);
 
 #endif  /* PGSYSWATCH_COMMON_H */
@@ -12,6 +12,30 @@ Copyright 2025 Alexander Scheglov */
 #include <stdlib.h>
 #include <string.h>
 #include "pgsyswatch_common.h"
+#include "pgsyswatch_cache.h"
+#include "pgsyswatch_stats.h"
+
+/* Function to read the interface lines of /proc/net/dev (headers skipped) */
+char *read_net_dev(void)
+{
+    CollectorScan scan;
+    pgsyswatch_stats_scan_begin(&scan, PGSYSWATCH_COLLECTOR_NET_MONITOR);
+
+    /* Read interface data */
+    char *lines = procfs_read_net_dev();
+    if (lines == NULL) {
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("Failed to open %s/net/dev", procfs_root())));
+    }
+
+    /* Move it from malloc'd into palloc'd memory */
+    char *interfaces = pstrdup(lines);
+    free(lines);
+    pgsyswatch_stats_scan_end(&scan, 0);
+
+    return interfaces;
+}
 
 /* Function to retrieve general network information */
 PG_FUNCTION_INFO_V1(net_monitor);
@@ -41,29 +65,8 @@ Datum net_monitor(PG_FUNCTION_ARGS)
         /* Save the type description in the context */
         funcctx->tuple_desc = BlessTupleDesc(tupdesc);
 
-        /* Open the file /proc/net/dev */
-        FILE *file = fopen("/proc/net/dev", "r");
-        if (file == NULL) {
-            ereport(ERROR,
-                    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-                     errmsg("Failed to open /proc/net/dev")));
-        }
-
-        /* Skip the first two lines (headers) */
-        char line[256];
-        fgets(line, sizeof(line), file); /* First line */
-        fgets(line, sizeof(line), file); /* Second line */
-
-        /* Read interface data and save it in the context */
-        StringInfoData interfaces;
-        initStringInfo(&interfaces);
-        while (fgets(line, sizeof(line), file)) {
-            appendStringInfo(&interfaces, "%s", line);
-        }
-        fclose(file);
-
-        /* Save the data in the context */
-        funcctx->user_fctx = interfaces.data;
+        /* Read interface data (possibly from the shared snapshot) and save it in the context */
+        funcctx->user_fctx = pgsyswatch_cached_net_dev(pgsyswatch_cache_staleness_arg(fcinfo, 0));
 
         /* Restore the memory context */
         MemoryContextSwitchTo(oldcontext);
@@ -81,27 +84,23 @@ Datum net_monitor(PG_FUNCTION_ARGS)
     }
 
     /* Parse the interface data line */
-    char face[32];
-    unsigned long long receive_bytes, receive_packets, receive_errs, receive_drop;
-    unsigned long long transmit_bytes, transmit_packets, transmit_errs, transmit_drop;
+    NetDevInfo info;
 
-    if (sscanf(interfaces, "%31[^:]: %llu %llu %llu %llu %*u %*u %*u %*u %llu %llu %llu %llu",
-               face, &receive_bytes, &receive_packets, &receive_errs, &receive_drop,
-               &transmit_bytes, &transmit_packets, &transmit_errs, &transmit_drop) == 9) {
+    if (procfs_parse_net_dev_line(interfaces, &info)) {
 
         /* Prepare data for return */
         Datum values[9];
         bool nulls[9] = {false};
 
-        values[0] = CStringGetTextDatum(face);
-        values[1] = Int64GetDatum(receive_bytes);
-        values[2] = Int64GetDatum(receive_packets);
-        values[3] = Int64GetDatum(receive_errs);
-        values[4] = Int64GetDatum(receive_drop);
-        values[5] = Int64GetDatum(transmit_bytes);
-        values[6] = Int64GetDatum(transmit_packets);
-        values[7] = Int64GetDatum(transmit_errs);
-        values[8] = Int64GetDatum(transmit_drop);
+        values[0] = CStringGetTextDatum(info.face);
+        values[1] = Int64GetDatum(info.receive_bytes);
+        values[2] = Int64GetDatum(info.receive_packets);
+        values[3] = Int64GetDatum(info.receive_errs);
+        values[4] = Int64GetDatum(info.receive_drop);
+        values[5] = Int64GetDatum(info.transmit_bytes);
+        values[6] = Int64GetDatum(info.transmit_packets);
+        values[7] = Int64GetDatum(info.transmit_errs);
+        values[8] = Int64GetDatum(info.transmit_drop);
 
         /* Create a tuple */
         HeapTuple tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
@@ -117,6 +116,7 @@ Datum net_monitor(PG_FUNCTION_ARGS)
         SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
     }
 
-    /* If the data is exhausted, finish the operation */
+    /* A line that does not parse ends the result early */
+    pgsyswatch_stats_parse_failure(PGSYSWATCH_COLLECTOR_NET_MONITOR);
     SRF_RETURN_DONE(funcctx);
 }
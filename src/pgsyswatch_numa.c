@@ -0,0 +1,239 @@
+/* src/pgsyswatch_numa.c
+SPDX-License-Identifier: Apache-2.0
+Copyright 2025 Alexander Scheglov */
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "access/htup_details.h"
+#include "catalog/pg_type.h"
+#include "utils/builtins.h"
+#include <stdlib.h>
+#include <string.h>
+
+#include "pgsyswatch_numa.h"
+#include "pgsyswatch_cache.h"
+#include "pgsyswatch_proc_events.h"
+#include "pgsyswatch_stats.h"
+
+/*
+ * NUMA locality.
+ *
+ * A backend running on one node while its work_mem and the shared_buffers
+ * pages it touches sit on another pays for every access across the
+ * interconnect. proc_numa() puts the two side by side for the postmaster
+ * and its children: the memory of each process per node from numa_maps
+ * (split into private anonymous, mapped files and shared memory) and the
+ * node of the CPU it last ran on. numa_nodes() shows the nodes themselves.
+ *
+ * Reading numa_maps walks the page tables of the process, so the scan of
+ * all server processes goes through the shared snapshot cache like
+ * proc_monitor_all().
+ */
+
+/* Function to find the node a CPU belongs to */
+static int numa_cpu_node(const NumaNodeInfo *nodes, int nnodes, int cpu) {
+    int i;
+
+    for (i = 0; i < nnodes; i++) {
+        if (sysfs_cpulist_contains(nodes[i].cpulist, cpu))
+            return nodes[i].node;
+    }
+    return -1;
+}
+
+/* Function to read the numa_maps of one process or of all server processes */
+ProcNumaRow *collect_numa(int pid, int *nrows) {
+    NumaNodeInfo nodes[PROCFS_MAX_NUMA_NODES];
+    NumaNodeUsage usage[PROCFS_MAX_NUMA_NODES];
+    ProcNumaRow *rows;
+    CollectorScan scan;
+    int capacity = 64;
+    int nnodes;
+    int count;
+    int *pids;
+    int i;
+
+    pgsyswatch_stats_scan_begin(&scan, PGSYSWATCH_COLLECTOR_PROC_NUMA);
+
+    /* Without node directories (no NUMA support) there is just node 0 and no CPU mapping */
+    nnodes = sysfs_read_numa_nodes(nodes, PROCFS_MAX_NUMA_NODES);
+
+    if (pid != 0) {
+        pids = (int *) malloc(sizeof(int));
+        if (pids != NULL) {
+            pids[0] = pid;
+        }
+        count = (pids != NULL) ? 1 : -1;
+    } else {
+        count = pgsyswatch_proc_events_pids(&pids);
+        if (count < 0) {
+            count = procfs_read_pids(&pids);
+        }
+    }
+    if (count < 0) {
+        ereport(ERROR,
+                (errcode_for_file_access(),
+                 errmsg("could not open directory %s", procfs_root())));
+    }
+
+    rows = (ProcNumaRow *) palloc(capacity * sizeof(ProcNumaRow));
+    *nrows = 0;
+    for (i = 0; i < count; i++) {
+        int ppid = 0;
+        int last_cpu = -1;
+        int cpu_node;
+        int n;
+        int node;
+
+        if (!procfs_read_cpu_placement(pids[i], &ppid, &last_cpu))
+            continue;
+        /* Only the server: the postmaster and its children */
+        if (pid == 0 && pids[i] != PostmasterPid && ppid != PostmasterPid)
+            continue;
+
+        memset(usage, 0, sizeof(usage));
+        n = procfs_read_numa_maps(pids[i], usage, PROCFS_MAX_NUMA_NODES);
+        cpu_node = numa_cpu_node(nodes, Max(nnodes, 0), last_cpu);
+
+        for (node = 0; node < n; node++) {
+            ProcNumaRow *row;
+
+            if (usage[node].anon_kb == 0 && usage[node].file_kb == 0 && usage[node].shmem_kb == 0)
+                continue;
+            if (*nrows == capacity) {
+                capacity *= 2;
+                rows = (ProcNumaRow *) repalloc(rows, capacity * sizeof(ProcNumaRow));
+            }
+            row = &rows[(*nrows)++];
+            row->pid = pids[i];
+            row->last_cpu = last_cpu;
+            row->cpu_node = cpu_node;
+            row->node = node;
+            row->usage = usage[node];
+        }
+    }
+    free(pids);
+
+    pgsyswatch_stats_scan_end(&scan, count);
+    return rows;
+}
+
+/* Function to return the memory of server processes per NUMA node */
+PG_FUNCTION_INFO_V1(proc_numa);
+
+Datum proc_numa(PG_FUNCTION_ARGS)
+{
+    FuncCallContext *funcctx;
+    ProcNumaRow *rows;
+
+    if (SRF_IS_FIRSTCALL()) {
+        MemoryContext oldcontext;
+        TupleDesc tupdesc;
+        int nrows;
+
+        funcctx = SRF_FIRSTCALL_INIT();
+        oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+        if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE) {
+            ereport(ERROR,
+                    (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                     errmsg("Function returning record called in context that cannot accept type record")));
+        }
+        funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+        /* A single process is read directly; the whole server (NULL or 0) goes through the cache */
+        if (!PG_ARGISNULL(0) && PG_GETARG_INT32(0) != 0) {
+            rows = collect_numa(PG_GETARG_INT32(0), &nrows);
+        } else {
+            rows = pgsyswatch_cached_numa(pgsyswatch_cache_staleness_arg(fcinfo, 1), &nrows);
+        }
+
+        funcctx->user_fctx = rows;
+        funcctx->max_calls = nrows;
+
+        MemoryContextSwitchTo(oldcontext);
+    }
+
+    funcctx = SRF_PERCALL_SETUP();
+    rows = (ProcNumaRow *) funcctx->user_fctx;
+
+    if (funcctx->call_cntr < funcctx->max_calls) {
+        ProcNumaRow *row = &rows[funcctx->call_cntr];
+        Datum values[7];
+        bool nulls[7] = {false};
+        HeapTuple tuple;
+
+        values[0] = Int32GetDatum(row->pid);
+        values[1] = Int32GetDatum(row->last_cpu);
+        values[2] = Int32GetDatum(row->cpu_node);
+        nulls[2] = (row->cpu_node < 0);
+        values[3] = Int32GetDatum(row->node);
+        values[4] = Float8GetDatum(row->usage.anon_kb / 1024.0);
+        values[5] = Float8GetDatum(row->usage.file_kb / 1024.0);
+        values[6] = Float8GetDatum(row->usage.shmem_kb / 1024.0);
+
+        tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+        SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+    }
+
+    SRF_RETURN_DONE(funcctx);
+}
+
+/* Function to return the NUMA nodes with their CPUs and memory */
+PG_FUNCTION_INFO_V1(numa_nodes);
+
+Datum numa_nodes(PG_FUNCTION_ARGS)
+{
+    FuncCallContext *funcctx;
+    NumaNodeInfo *nodes;
+
+    if (SRF_IS_FIRSTCALL()) {
+        MemoryContext oldcontext;
+        TupleDesc tupdesc;
+        CollectorScan scan;
+        int count;
+
+        funcctx = SRF_FIRSTCALL_INIT();
+        oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+        if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE) {
+            ereport(ERROR,
+                    (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                     errmsg("Function returning record called in context that cannot accept type record")));
+        }
+        funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+        pgsyswatch_stats_scan_begin(&scan, PGSYSWATCH_COLLECTOR_SYSTEM_INFO);
+        nodes = (NumaNodeInfo *) palloc(PROCFS_MAX_NUMA_NODES * sizeof(NumaNodeInfo));
+        count = sysfs_read_numa_nodes(nodes, PROCFS_MAX_NUMA_NODES);
+        pgsyswatch_stats_scan_end(&scan, 0);
+
+        /* A kernel without NUMA support has no node directory: no rows rather than an error */
+        funcctx->user_fctx = nodes;
+        funcctx->max_calls = Max(count, 0);
+
+        MemoryContextSwitchTo(oldcontext);
+    }
+
+    funcctx = SRF_PERCALL_SETUP();
+    nodes = (NumaNodeInfo *) funcctx->user_fctx;
+
+    if (funcctx->call_cntr < funcctx->max_calls) {
+        NumaNodeInfo *node = &nodes[funcctx->call_cntr];
+        Datum values[5];
+        bool nulls[5] = {false};
+        HeapTuple tuple;
+
+        values[0] = Int32GetDatum(node->node);
+        values[1] = CStringGetTextDatum(node->cpulist);
+        values[2] = Float8GetDatum(node->total_kb / 1024.0);
+        values[3] = Float8GetDatum(node->free_kb / 1024.0);
+        values[4] = Float8GetDatum(node->used_kb / 1024.0);
+
+        tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+        SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+    }
+
+    SRF_RETURN_DONE(funcctx);
+}
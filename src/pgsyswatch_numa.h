@@ -0,0 +1,28 @@
+/* pgsyswatch_numa.h
+SPDX-License-Identifier: Apache-2.0
+Copyright 2025 Alexander Scheglov */
+#ifndef PGSYSWATCH_NUMA_H
+#define PGSYSWATCH_NUMA_H
+
+#include "postgres.h"
+#include "fmgr.h"
+
+#include "pgsyswatch_procfs.h"
+
+/* Memory of one process on one NUMA node, with where the process last ran */
+typedef struct ProcNumaRow {
+    int pid;
+    int last_cpu;                   /* CPU the process last ran on */
+    int cpu_node;                   /* Node of last_cpu, -1 if unknown */
+    int node;
+    NumaNodeUsage usage;
+} ProcNumaRow;
+
+/*
+ * Read the numa_maps of one process, or of the postmaster and all its
+ * children when pid is 0, into a palloc'd array with one row per process
+ * and node it has memory on.
+ */
+ProcNumaRow *collect_numa(int pid, int *nrows);
+
+#endif  /* PGSYSWATCH_NUMA_H */
@@ -0,0 +1,327 @@
+/* src/pgsyswatch_os_cache.c
+SPDX-License-Identifier: Apache-2.0
+Copyright 2025 Alexander Scheglov */
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "access/htup_details.h"
+#include "catalog/pg_type.h"
+#include "common/relpath.h"
+#include "executor/spi.h"
+#include "storage/fd.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pgsyswatch_os_cache.h"
+#include "pgsyswatch_stats.h"
+
+/*
+ * Kernel page cache residency of relation files.
+ *
+ * shared_buffers is only half of the caching picture: a block that is not
+ * there may still be a cheap read from the kernel's page cache. Like
+ * fincore(1), relation_os_cache() maps every segment file of a relation
+ * and asks mincore() which of its pages are resident. Mapping a file does
+ * not read it, and mincore() does not fault anything in, so measuring
+ * leaves the cache as it was. The kernel only answers for files the caller
+ * owns or may write to, which the server's own data files are.
+ *
+ * Files are mapped OS_CACHE_CHUNK_SIZE bytes at a time. Once
+ * pgsyswatch.os_cache_time_budget is spent, the remaining files are only
+ * sized, so that asking about a whole database stays bounded.
+ */
+
+/* GUC variables */
+int pgsyswatch_os_cache_time_budget = 10000;   /* ms, 0 means no limit */
+
+/* Bytes mapped and checked at a time */
+#define OS_CACHE_CHUNK_SIZE (64 * 1024 * 1024)
+
+/* One fork of one relation */
+typedef struct OsCacheRow {
+    Oid relid;
+    ForkNumber fork;
+    int segments;
+    uint64 size;                /* Bytes in all segment files */
+    uint64 scanned;             /* Bytes checked with mincore() */
+    uint64 cached;              /* Bytes found resident */
+} OsCacheRow;
+
+/* State of one relation_os_cache() call */
+typedef struct OsCacheState {
+    long page_size;
+    unsigned char *residency;   /* mincore() vector for one chunk */
+    TimestampTz deadline;       /* 0: no budget */
+    bool out_of_time;
+} OsCacheState;
+
+/* Function to define the page cache GUCs */
+void pgsyswatch_os_cache_init(void) {
+    DefineCustomIntVariable("pgsyswatch.os_cache_time_budget",
+                            "Time relation_os_cache() may spend checking page cache residency.",
+                            "Files not reached in time are only sized. 0 means no limit.",
+                            &pgsyswatch_os_cache_time_budget,
+                            10000, 0, INT_MAX,
+                            PGC_SUSET,
+                            GUC_UNIT_MS,
+                            NULL, NULL, NULL);
+}
+
+/* Function to check whether the time budget is spent */
+static bool os_cache_out_of_time(OsCacheState *state) {
+    if (!state->out_of_time && state->deadline != 0 && GetCurrentTimestamp() >= state->deadline) {
+        state->out_of_time = true;
+    }
+    return state->out_of_time;
+}
+
+/* Function to count the resident pages of one segment file; false if the file does not exist */
+static bool os_cache_segment(const char *path, OsCacheRow *row, OsCacheState *state) {
+    struct stat st;
+    off_t offset;
+    int fd;
+
+    fd = OpenTransientFile(path, O_RDONLY | PG_BINARY);
+    if (fd < 0) {
+        /* Past the last segment, or dropped meanwhile */
+        if (errno == ENOENT)
+            return false;
+        ereport(ERROR,
+                (errcode_for_file_access(),
+                 errmsg("could not open file \"%s\": %m", path)));
+    }
+    procfs_counters.files_opened++;
+
+    if (fstat(fd, &st) < 0) {
+        ereport(ERROR,
+                (errcode_for_file_access(),
+                 errmsg("could not stat file \"%s\": %m", path)));
+    }
+    row->segments++;
+    row->size += st.st_size;
+
+    for (offset = 0; offset < st.st_size; offset += OS_CACHE_CHUNK_SIZE) {
+        size_t len = Min(OS_CACHE_CHUNK_SIZE, st.st_size - offset);
+        size_t npages = (len + state->page_size - 1) / state->page_size;
+        uint64 resident = 0;
+        void *addr;
+        size_t i;
+
+        CHECK_FOR_INTERRUPTS();
+        if (os_cache_out_of_time(state))
+            break;
+
+        addr = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, offset);
+        if (addr == MAP_FAILED) {
+            ereport(ERROR,
+                    (errcode_for_file_access(),
+                     errmsg("could not map file \"%s\": %m", path)));
+        }
+        if (mincore(addr, len, state->residency) < 0) {
+            int save_errno = errno;
+
+            munmap(addr, len);
+            errno = save_errno;
+            ereport(ERROR,
+                    (errcode_for_file_access(),
+                     errmsg("could not check page cache residency of file \"%s\": %m", path)));
+        }
+        munmap(addr, len);
+
+        for (i = 0; i < npages; i++) {
+            resident += state->residency[i] & 1;
+        }
+        row->scanned += len;
+        /* The last page of a file may be partial */
+        row->cached += Min(resident * state->page_size, len);
+    }
+
+    if (CloseTransientFile(fd) != 0) {
+        ereport(ERROR,
+                (errcode_for_file_access(),
+                 errmsg("could not close file \"%s\": %m", path)));
+    }
+    return true;
+}
+
+/* Function to list the relations to measure with the path of their main fork, largest first */
+static int os_cache_list_relations(FunctionCallInfo fcinfo, MemoryContext mcxt, Oid **relids, char ***paths) {
+    Oid argtypes[1] = {OIDOID};
+    Datum args[1];
+    char argnulls[1] = {' '};
+    int ret;
+    uint64 i;
+    int count;
+
+    if (PG_ARGISNULL(0)) {
+        argnulls[0] = 'n';
+        args[0] = (Datum) 0;
+    } else {
+        args[0] = ObjectIdGetDatum(PG_GETARG_OID(0));
+    }
+
+    /* pg_relation_filepath() takes no lock; relations dropped meanwhile simply have no files */
+    SPI_connect();
+    ret = SPI_execute_with_args("SELECT c.oid, pg_catalog.pg_relation_filepath(c.oid) "
+                                "FROM pg_catalog.pg_class c "
+                                "WHERE ($1 IS NULL OR c.oid = $1) "
+                                "AND pg_catalog.pg_relation_filepath(c.oid) IS NOT NULL "
+                                "ORDER BY c.relpages DESC, c.oid",
+                                1, argtypes, args, argnulls, true, 0);
+    if (ret != SPI_OK_SELECT) {
+        elog(ERROR, "relation_os_cache: relation lookup failed: %s", SPI_result_code_string(ret));
+    }
+
+    count = (int) SPI_processed;
+    *relids = (Oid *) MemoryContextAlloc(mcxt, Max(count, 1) * sizeof(Oid));
+    *paths = (char **) MemoryContextAlloc(mcxt, Max(count, 1) * sizeof(char *));
+    for (i = 0; i < SPI_processed; i++) {
+        HeapTuple tuple = SPI_tuptable->vals[i];
+        bool isnull;
+
+        (*relids)[i] = DatumGetObjectId(SPI_getbinval(tuple, SPI_tuptable->tupdesc, 1, &isnull));
+        (*paths)[i] = MemoryContextStrdup(mcxt, SPI_getvalue(tuple, SPI_tuptable->tupdesc, 2));
+    }
+    SPI_finish();
+
+    return count;
+}
+
+/* Function to return how much of each relation fork is in the kernel page cache */
+PG_FUNCTION_INFO_V1(relation_os_cache);
+
+Datum relation_os_cache(PG_FUNCTION_ARGS)
+{
+    FuncCallContext *funcctx;
+    OsCacheRow *rows;
+
+    if (SRF_IS_FIRSTCALL()) {
+        MemoryContext oldcontext;
+        TupleDesc tupdesc;
+        OsCacheState state;
+        CollectorScan scan;
+        Oid *relids;
+        char **paths;
+        int nrelations;
+        int nrows = 0;
+        int capacity;
+        uint64 total_size = 0;
+        uint64 total_scanned = 0;
+        int r;
+
+        funcctx = SRF_FIRSTCALL_INIT();
+
+        if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE) {
+            ereport(ERROR,
+                    (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                     errmsg("Function returning record called in context that cannot accept type record")));
+        }
+        oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+        funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+        MemoryContextSwitchTo(oldcontext);
+
+        nrelations = os_cache_list_relations(fcinfo, funcctx->multi_call_memory_ctx, &relids, &paths);
+
+        oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+        state.page_size = sysconf(_SC_PAGESIZE);
+        state.residency = (unsigned char *) palloc(OS_CACHE_CHUNK_SIZE / state.page_size + 1);
+        state.deadline = pgsyswatch_os_cache_time_budget > 0
+            ? TimestampTzPlusMilliseconds(GetCurrentTimestamp(), pgsyswatch_os_cache_time_budget)
+            : 0;
+        state.out_of_time = false;
+
+        capacity = Max(nrelations, 1);
+        rows = (OsCacheRow *) palloc(capacity * sizeof(OsCacheRow));
+
+        pgsyswatch_stats_scan_begin(&scan, PGSYSWATCH_COLLECTOR_RELATION_OS_CACHE);
+        for (r = 0; r < nrelations; r++) {
+            ForkNumber fork;
+
+            for (fork = MAIN_FORKNUM; fork <= MAX_FORKNUM; fork++) {
+                OsCacheRow row = {relids[r], fork, 0, 0, 0, 0};
+                char path[MAXPGPATH];
+                char base[MAXPGPATH];
+                int segno;
+
+                if (fork == MAIN_FORKNUM) {
+                    strlcpy(base, paths[r], sizeof(base));
+                } else {
+                    snprintf(base, sizeof(base), "%s_%s", paths[r], forkNames[fork]);
+                }
+
+                /* Segment 0 has no suffix, the following ones are base.1, base.2, ... */
+                for (segno = 0;; segno++) {
+                    if (segno == 0) {
+                        strlcpy(path, base, sizeof(path));
+                    } else {
+                        snprintf(path, sizeof(path), "%s.%d", base, segno);
+                    }
+                    if (!os_cache_segment(path, &row, &state))
+                        break;
+                }
+
+                if (row.segments == 0)
+                    continue;
+                if (nrows == capacity) {
+                    capacity *= 2;
+                    rows = (OsCacheRow *) repalloc(rows, capacity * sizeof(OsCacheRow));
+                }
+                rows[nrows++] = row;
+                total_size += row.size;
+                total_scanned += row.scanned;
+            }
+        }
+        pgsyswatch_stats_scan_end(&scan, 0);
+
+        if (state.out_of_time) {
+            ereport(NOTICE,
+                    (errmsg("relation_os_cache: time budget spent after checking %.0f of %.0f MB",
+                            total_scanned / (1024.0 * 1024.0), total_size / (1024.0 * 1024.0)),
+                     errhint("The other files were only sized; raise pgsyswatch.os_cache_time_budget to check them.")));
+        }
+
+        funcctx->user_fctx = rows;
+        funcctx->max_calls = nrows;
+
+        MemoryContextSwitchTo(oldcontext);
+    }
+
+    funcctx = SRF_PERCALL_SETUP();
+    rows = (OsCacheRow *) funcctx->user_fctx;
+
+    if (funcctx->call_cntr < funcctx->max_calls) {
+        OsCacheRow *row = &rows[funcctx->call_cntr];
+        Datum values[7];
+        bool nulls[7] = {false};
+        HeapTuple tuple;
+
+        values[0] = ObjectIdGetDatum(row->relid);
+        values[1] = CStringGetTextDatum(forkNames[row->fork]);
+        values[2] = Int32GetDatum(row->segments);
+        values[3] = Float8GetDatum(row->size / (1024.0 * 1024.0));
+        values[4] = Float8GetDatum(row->scanned / (1024.0 * 1024.0));
+        values[5] = Float8GetDatum(row->cached / (1024.0 * 1024.0));
+        /* Share of the part that was checked; nothing to say if the budget ran out before */
+        if (row->scanned > 0) {
+            values[6] = Float8GetDatum(100.0 * row->cached / row->scanned);
+        } else {
+            nulls[5] = (row->size > 0);
+            nulls[6] = true;
+        }
+
+        tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+        SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+    }
+
+    SRF_RETURN_DONE(funcctx);
+}
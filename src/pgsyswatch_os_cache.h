@@ -0,0 +1,16 @@
+/* pgsyswatch_os_cache.h
+SPDX-License-Identifier: Apache-2.0
+Copyright 2025 Alexander Scheglov */
+#ifndef PGSYSWATCH_OS_CACHE_H
+#define PGSYSWATCH_OS_CACHE_H
+
+#include "postgres.h"
+#include "fmgr.h"
+
+/* GUC variables */
+extern int pgsyswatch_os_cache_time_budget;
+
+/* Defines GUCs (called from _PG_init) */
+void pgsyswatch_os_cache_init(void);
+
+#endif  /* PGSYSWATCH_OS_CACHE_H */
@@ -0,0 +1,698 @@
+/* src/pgsyswatch_proc_events.c
+SPDX-License-Identifier: Apache-2.0
+Copyright 2025 Alexander Scheglov */
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "access/htup_details.h"
+#include "catalog/pg_authid.h"
+#include "port/atomics.h"
+#include "port/pg_bitutils.h"
+#include "postmaster/bgworker.h"
+#include "postmaster/interrupt.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "tcop/tcopprot.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/timestamp.h"
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+
+#include "pgsyswatch_proc_events.h"
+#include "pgsyswatch_procfs.h"
+#include "pgsyswatch_stats.h"
+
+/*
+ * Process lifecycle events.
+ *
+ * proc_monitor_all() samples: a process that starts and exits between two
+ * collector ticks is never seen, and neither is what it cost. This worker
+ * subscribes to the kernel's proc connector (a netlink multicast of fork,
+ * exec and exit events) and reacts to each exit while the process is still
+ * a zombie, reading its final utime/stime (dead threads included) and I/O
+ * from /proc. The exits wait in a ring in shared memory until
+ * proc_exit_events(true) drains them. The collector worker reads them with
+ * proc_exit_events(false) once per tick and only removes them, through
+ * pgsyswatch_proc_events_ack(), once they are stored in process_exits or
+ * spooled, so that a failed tick loses none.
+ *
+ * Fork and exit events also keep a set of live PIDs in shared memory, which
+ * proc_monitor_all() uses instead of a readdir() of /proc. After a socket
+ * overrun (events were lost) the set is rebuilt from /proc, and it is not
+ * used while that happens or when the worker is not running.
+ *
+ * Subscribing needs CAP_NET_ADMIN in the initial user namespace; without
+ * it the worker logs why and exits for good.
+ */
+
+/* GUC variables */
+bool pgsyswatch_proc_events = false;
+int pgsyswatch_proc_events_buffer = 16384;   /* Exits kept until drained */
+
+/* PID_MAX_LIMIT on 64-bit kernels: the highest pid_max can be set to */
+#define PROC_EVENTS_MAX_PID (4 * 1024 * 1024)
+#define PROC_EVENTS_PID_WORDS (PROC_EVENTS_MAX_PID / 64)
+
+/* How long the worker waits for the kernel to acknowledge the subscription */
+#define PROC_EVENTS_ACK_TIMEOUT 5000   /* ms */
+
+/* Receive buffer asked for, so that fork storms do not overrun the socket */
+#define PROC_EVENTS_SOCKET_BUFFER (4 * 1024 * 1024)
+
+/* Exits collected before they are published to the ring */
+#define PROC_EVENTS_BATCH 256
+
+/* An exited process as kept in the ring */
+typedef struct ProcExitEntry {
+    int pid;
+    int exit_code;              /* Wait status: exit status << 8 | terminating signal */
+    TimestampTz exited_at;
+    double lifetime;            /* s, valid with info.have_stat */
+    ProcessExitInfo info;
+} ProcExitEntry;
+
+typedef struct ProcEventsShared {
+    LWLock *lock;               /* Protects the ring */
+    uint64 head;                /* Exits ever published */
+    uint64 tail;                /* Exits ever drained or overwritten */
+    uint64 dropped;             /* Overwritten before they were drained */
+    bool overflowing;           /* Dropped since the last drain; logged once */
+    int capacity;
+    pg_atomic_uint32 pids_valid;   /* The PID set mirrors the running processes */
+    pg_atomic_uint64 pids[PROC_EVENTS_PID_WORDS];
+    ProcExitEntry exits[FLEXIBLE_ARRAY_MEMBER];
+} ProcEventsShared;
+
+static ProcEventsShared *proc_events = NULL;
+
+/* Head of the ring as of the last proc_exit_events() call of this backend */
+static uint64 proc_events_read_head = 0;
+
+/* Subscription state of the worker */
+static bool proc_events_acked = false;
+static int proc_events_ack_err = 0;
+
+/* Function to compute the size of the shared state */
+static Size proc_events_shmem_size(void) {
+    return add_size(offsetof(ProcEventsShared, exits),
+                    mul_size(pgsyswatch_proc_events_buffer, sizeof(ProcExitEntry)));
+}
+
+/* Function to reserve shared memory and the lock, when the worker is enabled */
+void pgsyswatch_proc_events_shmem_request(void) {
+    if (!pgsyswatch_proc_events)
+        return;
+
+    RequestAddinShmemSpace(proc_events_shmem_size());
+    RequestNamedLWLockTranche("pgsyswatch_proc_events", 1);
+}
+
+/* Function to attach to (and on first use initialize) the shared state; AddinShmemInitLock is held */
+void pgsyswatch_proc_events_shmem_startup(void) {
+    bool found;
+    int i;
+
+    if (!pgsyswatch_proc_events)
+        return;
+
+    proc_events = ShmemInitStruct("pgsyswatch_proc_events", proc_events_shmem_size(), &found);
+    if (!found) {
+        proc_events->lock = &(GetNamedLWLockTranche("pgsyswatch_proc_events"))->lock;
+        proc_events->head = 0;
+        proc_events->tail = 0;
+        proc_events->dropped = 0;
+        proc_events->overflowing = false;
+        proc_events->capacity = pgsyswatch_proc_events_buffer;
+        pg_atomic_init_u32(&proc_events->pids_valid, 0);
+        for (i = 0; i < PROC_EVENTS_PID_WORDS; i++) {
+            pg_atomic_init_u64(&proc_events->pids[i], 0);
+        }
+    }
+}
+
+/* Function to define GUCs and register the proc events worker */
+void pgsyswatch_proc_events_init(void) {
+    BackgroundWorker worker;
+
+    DefineCustomBoolVariable("pgsyswatch.proc_events",
+                             "Starts a worker that records process exits from the kernel proc connector.",
+                             "Needs CAP_NET_ADMIN.",
+                             &pgsyswatch_proc_events,
+                             false,
+                             PGC_POSTMASTER,
+                             0,
+                             NULL, NULL, NULL);
+
+    DefineCustomIntVariable("pgsyswatch.proc_events_buffer",
+                            "Number of process exits kept until proc_exit_events() drains them.",
+                            "When full, the oldest exits are overwritten.",
+                            &pgsyswatch_proc_events_buffer,
+                            16384, 16, INT_MAX / 2,
+                            PGC_POSTMASTER,
+                            0,
+                            NULL, NULL, NULL);
+
+    if (!process_shared_preload_libraries_in_progress || !pgsyswatch_proc_events)
+        return;
+
+    memset(&worker, 0, sizeof(worker));
+    worker.bgw_flags = BGWORKER_SHMEM_ACCESS;
+    worker.bgw_start_time = BgWorkerStart_PostmasterStart;
+    worker.bgw_restart_time = 10;
+    snprintf(worker.bgw_library_name, BGW_MAXLEN, "pgsyswatch");
+    snprintf(worker.bgw_function_name, BGW_MAXLEN, "pgsyswatch_proc_events_main");
+    snprintf(worker.bgw_name, BGW_MAXLEN, "pgsyswatch proc events");
+    snprintf(worker.bgw_type, BGW_MAXLEN, "pgsyswatch proc events");
+    RegisterBackgroundWorker(&worker);
+}
+
+/* Function to add a PID to or remove it from the live set */
+static void proc_events_mark_pid(int pid, bool alive) {
+    uint64 bit;
+
+    if (pid <= 0 || pid >= PROC_EVENTS_MAX_PID)
+        return;
+
+    bit = UINT64CONST(1) << (pid % 64);
+    if (alive) {
+        pg_atomic_fetch_or_u64(&proc_events->pids[pid / 64], bit);
+    } else {
+        pg_atomic_fetch_and_u64(&proc_events->pids[pid / 64], ~bit);
+    }
+}
+
+/* Function to rebuild the live PID set from /proc; the set is not used meanwhile */
+static void proc_events_sync_pids(void) {
+    int *pids;
+    int count;
+    int i;
+
+    pg_atomic_write_u32(&proc_events->pids_valid, 0);
+    pg_memory_barrier();
+
+    for (i = 0; i < PROC_EVENTS_PID_WORDS; i++) {
+        pg_atomic_write_u64(&proc_events->pids[i], 0);
+    }
+
+    /* Events are queued on the socket meanwhile and applied afterwards, so nothing falls in between */
+    count = procfs_read_pids(&pids);
+    if (count < 0) {
+        ereport(WARNING,
+                (errcode_for_file_access(),
+                 errmsg("pgsyswatch proc events: could not open directory %s: %m", procfs_root())));
+        return;
+    }
+    for (i = 0; i < count; i++) {
+        proc_events_mark_pid(pids[i], true);
+    }
+    free(pids);
+
+    /* The set only stands in for the real /proc */
+    if (strcmp(procfs_root(), "/proc") == 0) {
+        pg_memory_barrier();
+        pg_atomic_write_u32(&proc_events->pids_valid, 1);
+    }
+}
+
+/* Function to stop readers from trusting the PID set once the worker is gone */
+static void proc_events_shmem_exit(int code, Datum arg) {
+    pg_atomic_write_u32(&proc_events->pids_valid, 0);
+}
+
+/* Function to list the live PIDs kept by the worker */
+int pgsyswatch_proc_events_pids(int **pids) {
+    int capacity = 1024;
+    int count = 0;
+    int i;
+
+    if (proc_events == NULL || strcmp(procfs_root(), "/proc") != 0 ||
+        pg_atomic_read_u32(&proc_events->pids_valid) == 0)
+        return -1;
+
+    *pids = malloc(capacity * sizeof(int));
+    if (*pids == NULL)
+        return -1;
+
+    for (i = 0; i < PROC_EVENTS_PID_WORDS; i++) {
+        uint64 word = pg_atomic_read_u64(&proc_events->pids[i]);
+
+        while (word != 0) {
+            if (count == capacity) {
+                int *grown = realloc(*pids, capacity * 2 * sizeof(int));
+
+                if (grown == NULL) {
+                    free(*pids);
+                    return -1;
+                }
+                *pids = grown;
+                capacity *= 2;
+            }
+            (*pids)[count++] = i * 64 + pg_rightmost_one_pos64(word);
+            word &= word - 1;
+        }
+    }
+
+    /* A resync may have started while the set was read */
+    pg_memory_barrier();
+    if (pg_atomic_read_u32(&proc_events->pids_valid) == 0) {
+        free(*pids);
+        return -1;
+    }
+    return count;
+}
+
+/* Function to publish a batch of exits, overwriting the oldest ones when the ring is full */
+static void proc_events_publish(ProcExitEntry *exits, int nexits) {
+    uint64 dropped_before;
+    bool log_overflow = false;
+    int i;
+
+    if (nexits == 0)
+        return;
+
+    LWLockAcquire(proc_events->lock, LW_EXCLUSIVE);
+    dropped_before = proc_events->dropped;
+    for (i = 0; i < nexits; i++) {
+        if (proc_events->head - proc_events->tail == (uint64) proc_events->capacity) {
+            proc_events->tail++;
+            proc_events->dropped++;
+        }
+        proc_events->exits[proc_events->head % proc_events->capacity] = exits[i];
+        proc_events->head++;
+    }
+    if (proc_events->dropped != dropped_before && !proc_events->overflowing) {
+        proc_events->overflowing = true;
+        log_overflow = true;
+    }
+    LWLockRelease(proc_events->lock);
+
+    if (log_overflow) {
+        ereport(LOG,
+                (errmsg("pgsyswatch proc events: exit buffer is full, the oldest exits are being overwritten"),
+                 errhint("Increase pgsyswatch.proc_events_buffer or drain proc_exit_events() more often.")));
+    }
+}
+
+/* Function to read the clock a proc connector event is stamped with, and the others at the same moment */
+static void proc_events_clocks(uint64 *monotonic_ns, double *boottime_s, TimestampTz *now) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    *monotonic_ns = (uint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    *boottime_s = ts.tv_sec + ts.tv_nsec / 1e9;
+    *now = GetCurrentTimestamp();
+}
+
+/* Function to read the final accounting of an exited process while it is a zombie */
+static void proc_events_record_exit(struct proc_event *ev, ProcExitEntry *entry) {
+    static long clock_ticks = 0;
+    uint64 monotonic_ns;
+    double boottime_s;
+    TimestampTz now;
+    int64 age_ns;
+
+    if (clock_ticks == 0) {
+        clock_ticks = sysconf(_SC_CLK_TCK);
+    }
+
+    memset(entry, 0, sizeof(*entry));
+    entry->pid = ev->event_data.exit.process_tgid;
+    entry->exit_code = ev->event_data.exit.exit_code;
+    (void) procfs_read_exit_info(entry->pid, &entry->info);
+
+    /* The event is stamped with CLOCK_MONOTONIC: go back from now by its age */
+    proc_events_clocks(&monotonic_ns, &boottime_s, &now);
+    age_ns = (int64) (monotonic_ns - ev->timestamp_ns);
+    if (age_ns < 0) {
+        age_ns = 0;
+    }
+    entry->exited_at = now - age_ns / 1000;
+    if (entry->info.have_stat) {
+        entry->lifetime = boottime_s - age_ns / 1e9 - (double) entry->info.starttime / clock_ticks;
+        if (entry->lifetime < 0) {
+            entry->lifetime = 0;
+        }
+    }
+}
+
+/* Function to read every queued message off the socket; returns the number of exits recorded */
+static int proc_events_receive(pgsocket sock) {
+    static union {
+        struct nlmsghdr header;
+        char data[65536];
+    } buf;
+    ProcExitEntry exits[PROC_EVENTS_BATCH];
+    int nexits = 0;
+    int total = 0;
+
+    for (;;) {
+        struct nlmsghdr *nlh;
+        ssize_t len = recv(sock, buf.data, sizeof(buf.data), 0);
+
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if (errno == ENOBUFS) {
+                /* The kernel dropped events: the PID set can no longer be trusted */
+                ereport(LOG,
+                        (errmsg("pgsyswatch proc events: socket overrun, events were lost; rebuilding the PID set")));
+                proc_events_sync_pids();
+                continue;
+            }
+            ereport(ERROR,
+                    (errcode_for_socket_access(),
+                     errmsg("pgsyswatch proc events: could not receive from netlink socket: %m")));
+        }
+
+        for (nlh = &buf.header; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+            struct cn_msg *cn;
+            struct proc_event *ev;
+
+            if (nlh->nlmsg_type == NLMSG_NOOP)
+                continue;
+            if (nlh->nlmsg_type == NLMSG_ERROR || nlh->nlmsg_type == NLMSG_OVERRUN)
+                break;
+
+            cn = (struct cn_msg *) NLMSG_DATA(nlh);
+            if (cn->id.idx != CN_IDX_PROC || cn->id.val != CN_VAL_PROC)
+                continue;
+            ev = (struct proc_event *) cn->data;
+
+            switch (ev->what) {
+            case PROC_EVENT_NONE:
+                /*
+                 * Acknowledgement of a subscription. Every listener sees all
+                 * of them and not all kernels echo our seq, so take the first.
+                 */
+                if (!proc_events_acked && cn->ack == 1) {
+                    proc_events_acked = true;
+                    proc_events_ack_err = ev->event_data.ack.err;
+                }
+                break;
+            case PROC_EVENT_FORK:
+                /* New threads are forks too; only new processes matter */
+                if (ev->event_data.fork.child_pid == ev->event_data.fork.child_tgid) {
+                    proc_events_mark_pid(ev->event_data.fork.child_tgid, true);
+                }
+                break;
+            case PROC_EVENT_EXIT:
+                if (ev->event_data.exit.process_pid == ev->event_data.exit.process_tgid) {
+                    proc_events_record_exit(ev, &exits[nexits++]);
+                    proc_events_mark_pid(ev->event_data.exit.process_tgid, false);
+                    if (nexits == PROC_EVENTS_BATCH) {
+                        proc_events_publish(exits, nexits);
+                        total += nexits;
+                        nexits = 0;
+                    }
+                }
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    proc_events_publish(exits, nexits);
+    return total + nexits;
+}
+
+/* Function to open the netlink socket and ask for proc events; PGINVALID_SOCKET (logged) on failure */
+static pgsocket proc_events_subscribe(void) {
+    struct sockaddr_nl addr;
+    union {
+        struct nlmsghdr header;
+        char data[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op))];
+    } msg;
+    struct cn_msg *cn;
+    enum proc_cn_mcast_op op = PROC_CN_MCAST_LISTEN;
+    int size = PROC_EVENTS_SOCKET_BUFFER;
+    pgsocket sock;
+
+    sock = socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+    if (sock == PGINVALID_SOCKET) {
+        ereport(LOG,
+                (errcode_for_socket_access(),
+                 errmsg("pgsyswatch proc events: could not create netlink socket: %m")));
+        return PGINVALID_SOCKET;
+    }
+
+    /* SO_RCVBUFFORCE ignores rmem_max; it needs the same capability as the subscription */
+    if (setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0) {
+        (void) setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = CN_IDX_PROC;
+    if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        ereport(LOG,
+                (errcode_for_socket_access(),
+                 errmsg("pgsyswatch proc events: could not join the proc connector group: %m"),
+                 errhint("The server needs CAP_NET_ADMIN; disable pgsyswatch.proc_events otherwise.")));
+        close(sock);
+        return PGINVALID_SOCKET;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.header.nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(op));
+    msg.header.nlmsg_type = NLMSG_DONE;
+    msg.header.nlmsg_pid = 0;
+    cn = (struct cn_msg *) NLMSG_DATA(&msg.header);
+    cn->id.idx = CN_IDX_PROC;
+    cn->id.val = CN_VAL_PROC;
+    cn->seq = 0;
+    cn->ack = 0;
+    cn->len = sizeof(op);
+    memcpy(cn->data, &op, sizeof(op));
+
+    if (send(sock, &msg, msg.header.nlmsg_len, 0) < 0) {
+        ereport(LOG,
+                (errcode_for_socket_access(),
+                 errmsg("pgsyswatch proc events: could not subscribe to the proc connector: %m")));
+        close(sock);
+        return PGINVALID_SOCKET;
+    }
+
+    return sock;
+}
+
+/* Function to wait for the kernel to acknowledge the subscription; false (logged) if it refused */
+static bool proc_events_wait_for_ack(pgsocket sock) {
+    TimestampTz deadline = TimestampTzPlusMilliseconds(GetCurrentTimestamp(), PROC_EVENTS_ACK_TIMEOUT);
+
+    while (!proc_events_acked) {
+        long timeout = TimestampDifferenceMilliseconds(GetCurrentTimestamp(), deadline);
+        int rc;
+
+        if (timeout <= 0) {
+            /* The kernel ignores subscriptions from outside the initial namespaces without an answer */
+            ereport(LOG,
+                    (errmsg("pgsyswatch proc events: the kernel did not acknowledge the subscription"),
+                     errhint("The proc connector only serves the initial user and PID namespaces.")));
+            return false;
+        }
+
+        rc = WaitLatchOrSocket(MyLatch,
+                               WL_LATCH_SET | WL_SOCKET_READABLE | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+                               sock, timeout, PG_WAIT_EXTENSION);
+        if (rc & WL_LATCH_SET) {
+            ResetLatch(MyLatch);
+            CHECK_FOR_INTERRUPTS();
+        }
+        if (rc & WL_SOCKET_READABLE) {
+            (void) proc_events_receive(sock);
+        }
+    }
+
+    if (proc_events_ack_err != 0) {
+        ereport(LOG,
+                (errmsg("pgsyswatch proc events: the kernel refused the subscription: %s",
+                        strerror(proc_events_ack_err)),
+                 errhint("The server needs CAP_NET_ADMIN; disable pgsyswatch.proc_events otherwise.")));
+        return false;
+    }
+    return true;
+}
+
+/* Entry point of the proc events background worker */
+void pgsyswatch_proc_events_main(Datum main_arg) {
+    pgsocket sock;
+
+    pqsignal(SIGHUP, SignalHandlerForConfigReload);
+    pqsignal(SIGTERM, die);
+    BackgroundWorkerUnblockSignals();
+
+    /* Exiting with 0 unregisters the worker: without the capability, retrying is pointless */
+    sock = proc_events_subscribe();
+    if (sock == PGINVALID_SOCKET || !proc_events_wait_for_ack(sock)) {
+        proc_exit(0);
+    }
+
+    before_shmem_exit(proc_events_shmem_exit, (Datum) 0);
+    proc_events_sync_pids();
+
+    ereport(LOG,
+            (errmsg("pgsyswatch proc events started: buffer of %d exits", proc_events->capacity)));
+
+    for (;;) {
+        int rc = WaitLatchOrSocket(MyLatch,
+                                   WL_LATCH_SET | WL_SOCKET_READABLE | WL_EXIT_ON_PM_DEATH,
+                                   sock, -1L, PG_WAIT_EXTENSION);
+
+        if (rc & WL_LATCH_SET) {
+            ResetLatch(MyLatch);
+        }
+        CHECK_FOR_INTERRUPTS();
+
+        if (ConfigReloadPending) {
+            ConfigReloadPending = false;
+            ProcessConfigFile(PGC_SIGHUP);
+        }
+
+        if (rc & WL_SOCKET_READABLE) {
+            CollectorScan scan;
+            int nexits;
+
+            pgsyswatch_stats_scan_begin(&scan, PGSYSWATCH_COLLECTOR_PROC_EVENTS);
+            nexits = proc_events_receive(sock);
+            pgsyswatch_stats_scan_end(&scan, nexits);
+        }
+    }
+}
+
+/* Function to get the head of the ring as of the last proc_exit_events() call, 0 without the worker */
+uint64 pgsyswatch_proc_events_read_head(void) {
+    return proc_events_read_head;
+}
+
+/* Function to remove the exits before head, once the collector worker has stored or spooled them */
+void pgsyswatch_proc_events_ack(uint64 head) {
+    if (proc_events == NULL)
+        return;
+
+    LWLockAcquire(proc_events->lock, LW_EXCLUSIVE);
+    /* Exits overwritten or drained by someone else meanwhile are already gone */
+    if (head > proc_events->tail) {
+        proc_events->tail = head;
+        proc_events->overflowing = false;
+    }
+    LWLockRelease(proc_events->lock);
+}
+
+/* Function to return the process exits recorded by the worker, optionally removing them */
+PG_FUNCTION_INFO_V1(proc_exit_events);
+
+Datum proc_exit_events(PG_FUNCTION_ARGS)
+{
+    FuncCallContext *funcctx;
+    ProcExitEntry *exits;
+
+    if (SRF_IS_FIRSTCALL()) {
+        MemoryContext oldcontext;
+        TupleDesc tupdesc;
+        bool drain = !PG_ARGISNULL(0) && PG_GETARG_BOOL(0);
+        uint64 count = 0;
+
+        funcctx = SRF_FIRSTCALL_INIT();
+        oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+        if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE) {
+            ereport(ERROR,
+                    (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                     errmsg("Function returning record called in context that cannot accept type record")));
+        }
+        funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+        /* Draining takes the exits away from the collector worker: not for every role */
+        if (drain && !has_privs_of_role(GetUserId(), ROLE_PG_MONITOR)) {
+            ereport(ERROR,
+                    (errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+                     errmsg("permission denied to drain the recorded process exits"),
+                     errdetail("Only superusers and members of pg_monitor may call proc_exit_events(true).")));
+        }
+
+        /* Without the worker there is nothing to return */
+        exits = NULL;
+        if (proc_events != NULL) {
+            uint64 i;
+
+            LWLockAcquire(proc_events->lock, drain ? LW_EXCLUSIVE : LW_SHARED);
+            count = proc_events->head - proc_events->tail;
+            exits = (ProcExitEntry *) palloc(Max(count, 1) * sizeof(ProcExitEntry));
+            for (i = 0; i < count; i++) {
+                exits[i] = proc_events->exits[(proc_events->tail + i) % proc_events->capacity];
+            }
+            if (drain) {
+                proc_events->tail = proc_events->head;
+                proc_events->overflowing = false;
+            }
+            proc_events_read_head = proc_events->head;
+            LWLockRelease(proc_events->lock);
+        }
+        funcctx->user_fctx = exits;
+        funcctx->max_calls = count;
+
+        MemoryContextSwitchTo(oldcontext);
+    }
+
+    funcctx = SRF_PERCALL_SETUP();
+    exits = (ProcExitEntry *) funcctx->user_fctx;
+
+    if (funcctx->call_cntr < funcctx->max_calls) {
+        ProcExitEntry *entry = &exits[funcctx->call_cntr];
+        Datum values[12];
+        bool nulls[12] = {false};
+        HeapTuple tuple;
+
+        values[0] = Int32GetDatum(entry->pid);
+        values[1] = Int32GetDatum(entry->info.ppid);
+        values[2] = CStringGetTextDatum(entry->info.comm);
+        /* Exactly one of exit status and terminating signal is set */
+        if (WIFSIGNALED(entry->exit_code)) {
+            nulls[3] = true;
+            values[4] = Int32GetDatum(WTERMSIG(entry->exit_code));
+        } else {
+            values[3] = Int32GetDatum(WEXITSTATUS(entry->exit_code));
+            nulls[4] = true;
+        }
+        values[5] = Int64GetDatum(entry->info.utime);
+        values[6] = Int64GetDatum(entry->info.stime);
+        values[7] = Int64GetDatum(entry->info.read_bytes);
+        values[8] = Int64GetDatum(entry->info.write_bytes);
+        values[9] = TimestampTzGetDatum(entry->exited_at - (TimestampTz) (entry->lifetime * USECS_PER_SEC));
+        values[10] = TimestampTzGetDatum(entry->exited_at);
+        values[11] = Float8GetDatum(entry->lifetime);
+
+        /* Reaped before the worker got to it: only the exit itself is known */
+        if (!entry->info.have_stat) {
+            nulls[1] = nulls[2] = nulls[5] = nulls[6] = nulls[9] = nulls[11] = true;
+        }
+        if (!entry->info.have_io) {
+            nulls[7] = nulls[8] = true;
+        }
+
+        tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+        SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+    }
+
+    SRF_RETURN_DONE(funcctx);
+}
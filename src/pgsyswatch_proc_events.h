@@ -0,0 +1,38 @@
+/* pgsyswatch_proc_events.h
+SPDX-License-Identifier: Apache-2.0
+Copyright 2025 Alexander Scheglov */
+#ifndef PGSYSWATCH_PROC_EVENTS_H
+#define PGSYSWATCH_PROC_EVENTS_H
+
+#include "postgres.h"
+#include "fmgr.h"
+
+/* GUC variables */
+extern bool pgsyswatch_proc_events;
+extern int pgsyswatch_proc_events_buffer;
+
+/* Defines GUCs and registers the background worker (called from _PG_init) */
+void pgsyswatch_proc_events_init(void);
+
+/* Shared memory request and attach, called from the hooks in pgsyswatch.c */
+void pgsyswatch_proc_events_shmem_request(void);
+void pgsyswatch_proc_events_shmem_startup(void);
+
+/*
+ * List the live PIDs from the set the worker maintains into a malloc'd
+ * array, like procfs_read_pids(); -1 if there is no such set to trust.
+ */
+int pgsyswatch_proc_events_pids(int **pids);
+
+/*
+ * Head of the ring as of the last proc_exit_events() call of this backend,
+ * and removal of the exits before it: the collector worker reads without
+ * draining and acknowledges once the exits are stored or spooled.
+ */
+uint64 pgsyswatch_proc_events_read_head(void);
+void pgsyswatch_proc_events_ack(uint64 head);
+
+/* Entry point of the background worker */
+PGDLLEXPORT void pgsyswatch_proc_events_main(Datum main_arg) pg_attribute_noreturn();
+
+#endif  /* PGSYSWATCH_PROC_EVENTS_H */
@@ -0,0 +1,707 @@
+/* src/pgsyswatch_procfs.c
+SPDX-License-Identifier: Apache-2.0
+Copyright 2025 Alexander Scheglov */
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pgsyswatch_procfs.h"
+
+/* GUC variables (NULL until the GUCs are defined, e.g. in the benchmark) */
+char *pgsyswatch_proc_root = NULL;
+char *pgsyswatch_sys_root = NULL;
+
+/* Work counters of the calling thread */
+__thread ProcfsCounters procfs_counters;
+
+/* Function to add one set of work counters to another */
+void procfs_counters_add(ProcfsCounters *into, const ProcfsCounters *from) {
+    into->files_opened += from->files_opened;
+    into->bytes_read += from->bytes_read;
+    into->parse_failures += from->parse_failures;
+    into->vanished += from->vanished;
+}
+
+/* Function to open a procfs file for reading, counting it */
+FILE *procfs_fopen(const char *path) {
+    FILE *file = fopen(path, "r");
+
+    if (file != NULL) {
+        procfs_counters.files_opened++;
+    }
+    return file;
+}
+
+/* Function to close a procfs file, counting what was consumed from it */
+void procfs_fclose(FILE *file) {
+    long consumed = ftell(file);
+
+    if (consumed > 0) {
+        procfs_counters.bytes_read += consumed;
+    }
+    fclose(file);
+}
+
+/* Function to return the procfs root without a trailing slash */
+const char *procfs_root(void) {
+    return (pgsyswatch_proc_root != NULL && pgsyswatch_proc_root[0] != '\0') ? pgsyswatch_proc_root : "/proc";
+}
+
+/* Function to return the sysfs root without a trailing slash */
+const char *sysfs_root(void) {
+    return (pgsyswatch_sys_root != NULL && pgsyswatch_sys_root[0] != '\0') ? pgsyswatch_sys_root : "/sys";
+}
+
+/* Function to calculate CPU usage percentage */
+static float calculate_cpu_usage(unsigned long long utime, unsigned long long stime, unsigned long long starttime, unsigned long long uptime) {
+    /* Total CPU time used by the process (in ticks) */
+    unsigned long long total_time = utime + stime;
+    /* Process uptime in seconds */
+    float seconds_since_start = (float)(uptime - starttime) / sysconf(_SC_CLK_TCK);
+    // Calculate CPU usage percentage
+    if (seconds_since_start > 0) {
+        return ((float)total_time / sysconf(_SC_CLK_TCK)) / seconds_since_start * 100.0;
+    }
+    return 0.0;
+}
+
+/* Function to retrieve process information */
+ProcessInfo get_process_info(int pid) {
+    ProcessInfo process;
+    char path[PATH_MAX];
+    FILE *file;
+    char line[256];
+    float rss, vmsize, swap;
+    unsigned long long starttime = 0;
+    unsigned long long uptime = 0;
+
+    /* Initialize the structure */
+    process.pid = pid;
+    process.command = NULL;
+    process.state = '\0';  
+    process.res_mb = 0.0;
+    process.virt_mb = 0.0;
+    process.swap_mb = 0.0;
+    process.utime = 0;
+    process.stime = 0;
+    process.cpu_usage = 0.0;
+    process.read_bytes = 0;
+    process.write_bytes = 0;
+    process.voluntary_ctxt_switches = 0;
+    process.nonvoluntary_ctxt_switches = 0;
+    process.threads = 0;
+
+    /* Read CPU information from /proc/[pid]/stat */
+    snprintf(path, sizeof(path), "%s/%d/stat", procfs_root(), pid);
+    file = procfs_fopen(path);
+    if (file != NULL) {
+        /* Format: pid, comm, state, ppid, ..., utime, stime, ..., nice, ... */
+        if (fscanf(file, "%*d %*s %c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %*d %*d %*d %*d %*d %*d %llu",
+                   &process.state, &process.utime, &process.stime, &starttime) != 4) {
+            procfs_counters.parse_failures++;
+        }
+        procfs_fclose(file);
+    } else if (errno == ENOENT || errno == ESRCH) {
+        /* The process exited after it was listed; its other files are gone too */
+        procfs_counters.vanished++;
+        return process;
+    }
+
+    /* Read uptime from /proc/uptime */
+    snprintf(path, sizeof(path), "%s/uptime", procfs_root());
+    file = procfs_fopen(path);
+    if (file != NULL) {
+        if (fscanf(file, "%llu", &uptime) == 1) {
+            uptime *= sysconf(_SC_CLK_TCK);  // Convert seconds to ticks
+        }
+        procfs_fclose(file);
+    }
+
+    /* Calculate CPU usage */
+    process.cpu_usage = calculate_cpu_usage(process.utime, process.stime, starttime, uptime);
+
+    /* Read memory information from /proc/[pid]/status */
+    snprintf(path, sizeof(path), "%s/%d/status", procfs_root(), pid);
+    file = procfs_fopen(path);
+    if (file != NULL) {
+        while (fgets(line, sizeof(line), file)) {
+            if (strncmp(line, "VmSize", 6) == 0) {
+                if (sscanf(line, "VmSize: %f", &vmsize) == 1) {
+                    process.virt_mb = vmsize / 1024.0;
+                }
+            } else if (strncmp(line, "VmRSS", 5) == 0) {
+                if (sscanf(line, "VmRSS: %f", &rss) == 1) {
+                    process.res_mb = rss / 1024.0;
+                }
+            } else if (strncmp(line, "VmSwap", 6) == 0) {
+                if (sscanf(line, "VmSwap: %f", &swap) == 1) {
+                    process.swap_mb = swap / 1024.0;
+                }
+            } else if (strncmp(line, "voluntary_ctxt_switches", 23) == 0) {
+                if (sscanf(line, "voluntary_ctxt_switches: %d", &process.voluntary_ctxt_switches) == 1) {
+                    /* Successfully parsed voluntary context switches */
+                }
+            } else if (strncmp(line, "nonvoluntary_ctxt_switches", 26) == 0) {
+                if (sscanf(line, "nonvoluntary_ctxt_switches: %d", &process.nonvoluntary_ctxt_switches) == 1) {
+                    /* Successfully parsed non-voluntary context switches */
+                }
+            } else if (strncmp(line, "Threads", 7) == 0) {
+                if (sscanf(line, "Threads: %d", &process.threads) == 1) {
+                    /* Successfully parsed thread count */
+                }
+            }
+        }
+        procfs_fclose(file);
+    }
+
+    /* Read disk I/O information from /proc/[pid]/io */
+    snprintf(path, sizeof(path), "%s/%d/io", procfs_root(), pid);
+    file = procfs_fopen(path);
+    if (file != NULL) {
+        while (fgets(line, sizeof(line), file)) {
+            if (strncmp(line, "read_bytes", 10) == 0) {
+                if (sscanf(line, "read_bytes: %lu", &process.read_bytes) == 1) {
+                    /* Successfully parsed read bytes */
+                }
+            } else if (strncmp(line, "write_bytes", 11) == 0) {
+                if (sscanf(line, "write_bytes: %lu", &process.write_bytes) == 1) {
+                    /* Successfully parsed write bytes */
+                }
+            }
+        }
+        procfs_fclose(file);
+    }
+
+    /* Read command from /proc/[pid]/cmdline */
+    snprintf(path, sizeof(path), "%s/%d/cmdline", procfs_root(), pid);
+    file = procfs_fopen(path);
+    if (file != NULL) {
+        size_t len = 0;
+        ssize_t read;
+        read = getline(&process.command, &len, file);
+        if (read == -1) {
+            if (process.command != NULL) {
+                free(process.command);
+            }
+            process.command = strdup("Unknown");
+        }
+        procfs_fclose(file);
+    }
+
+    return process;
+}
+
+/* Function to read the final accounting of an exiting process */
+bool procfs_read_exit_info(int pid, ProcessExitInfo *info) {
+    char path[PATH_MAX];
+    char buf[1024];
+    char line[256];
+    FILE *file;
+    size_t len;
+    char *comm_start;
+    char *comm_end;
+
+    memset(info, 0, sizeof(*info));
+
+    snprintf(path, sizeof(path), "%s/%d/stat", procfs_root(), pid);
+    file = procfs_fopen(path);
+    if (file == NULL) {
+        if (errno == ENOENT || errno == ESRCH) {
+            procfs_counters.vanished++;
+        }
+        return false;
+    }
+    len = fread(buf, 1, sizeof(buf) - 1, file);
+    procfs_fclose(file);
+    buf[len] = '\0';
+
+    /* comm may contain spaces and parentheses: it ends at the last ')' */
+    comm_start = strchr(buf, '(');
+    comm_end = strrchr(buf, ')');
+    if (comm_start == NULL || comm_end == NULL || comm_end < comm_start ||
+        sscanf(comm_end + 1, " %*c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %*d %*d %*d %*d %*d %*d %llu",
+               &info->ppid, &info->utime, &info->stime, &info->starttime) != 4) {
+        procfs_counters.parse_failures++;
+        return false;
+    }
+    len = comm_end - comm_start - 1;
+    if (len >= sizeof(info->comm)) {
+        len = sizeof(info->comm) - 1;
+    }
+    memcpy(info->comm, comm_start + 1, len);
+    info->comm[len] = '\0';
+    info->have_stat = true;
+
+    snprintf(path, sizeof(path), "%s/%d/io", procfs_root(), pid);
+    file = procfs_fopen(path);
+    if (file != NULL) {
+        while (fgets(line, sizeof(line), file)) {
+            if (sscanf(line, "read_bytes: %llu", &info->read_bytes) == 1 ||
+                sscanf(line, "write_bytes: %llu", &info->write_bytes) == 1) {
+                info->have_io = true;
+            }
+        }
+        procfs_fclose(file);
+    }
+
+    return true;
+}
+
+/* Function to list the PIDs under the proc root */
+int procfs_read_pids(int **pids) {
+    DIR *dir;
+    struct dirent *ent;
+    int capacity = 1024;
+    int count = 0;
+    int *list;
+
+    *pids = NULL;
+    dir = opendir(procfs_root());
+    if (dir == NULL) {
+        return -1;
+    }
+
+    list = (int *) malloc(capacity * sizeof(int));
+    while (list != NULL && (ent = readdir(dir)) != NULL) {
+        if (ent->d_type == DT_DIR && atoi(ent->d_name) > 0) {
+            if (count >= capacity) {
+                int *grown = (int *) realloc(list, capacity * 2 * sizeof(int));
+                if (grown == NULL) {
+                    free(list);
+                    list = NULL;
+                    break;
+                }
+                list = grown;
+                capacity *= 2;
+            }
+            list[count++] = atoi(ent->d_name);
+        }
+    }
+    closedir(dir);
+
+    if (list == NULL) {
+        return -1;
+    }
+    *pids = list;
+    return count;
+}
+
+/* Function to read the interface lines of /proc/net/dev (headers skipped) */
+char *procfs_read_net_dev(void) {
+    char path[PATH_MAX];
+    char line[256];
+    FILE *file;
+    char *lines;
+    size_t capacity = 4096;
+    size_t len = 0;
+
+    snprintf(path, sizeof(path), "%s/net/dev", procfs_root());
+    file = procfs_fopen(path);
+    if (file == NULL) {
+        return NULL;
+    }
+    lines = malloc(capacity);
+    if (lines == NULL) {
+        procfs_fclose(file);
+        return NULL;
+    }
+    lines[0] = '\0';
+
+    /* The first two lines are headers */
+    if (fgets(line, sizeof(line), file) && fgets(line, sizeof(line), file)) {
+        while (fgets(line, sizeof(line), file)) {
+            size_t n = strlen(line);
+
+            if (len + n + 1 > capacity) {
+                char *grown = realloc(lines, capacity * 2);
+
+                if (grown == NULL) {
+                    free(lines);
+                    procfs_fclose(file);
+                    return NULL;
+                }
+                lines = grown;
+                capacity *= 2;
+            }
+            memcpy(lines + len, line, n + 1);
+            len += n;
+        }
+    }
+
+    procfs_fclose(file);
+    return lines;
+}
+
+/* Function to parse one interface line of /proc/net/dev */
+bool procfs_parse_net_dev_line(const char *line, NetDevInfo *info) {
+    return sscanf(line, "%31[^:]: %llu %llu %llu %llu %*u %*u %*u %*u %llu %llu %llu %llu",
+                  info->face, &info->receive_bytes, &info->receive_packets, &info->receive_errs, &info->receive_drop,
+                  &info->transmit_bytes, &info->transmit_packets, &info->transmit_errs, &info->transmit_drop) == 9;
+}
+
+/* Function to read the parent and the last CPU of a process */
+bool procfs_read_cpu_placement(int pid, int *ppid, int *last_cpu) {
+    char path[PATH_MAX];
+    char buf[1024];
+    FILE *file;
+    size_t len;
+    char *fields;
+    char *field;
+    char *saveptr;
+    int number;
+
+    snprintf(path, sizeof(path), "%s/%d/stat", procfs_root(), pid);
+    file = procfs_fopen(path);
+    if (file == NULL) {
+        if (errno == ENOENT || errno == ESRCH) {
+            procfs_counters.vanished++;
+        }
+        return false;
+    }
+    len = fread(buf, 1, sizeof(buf) - 1, file);
+    procfs_fclose(file);
+    buf[len] = '\0';
+
+    /* comm may contain spaces: the numbered fields start after the last ')', with the state (field 3) */
+    fields = strrchr(buf, ')');
+    if (fields == NULL) {
+        procfs_counters.parse_failures++;
+        return false;
+    }
+    number = 3;
+    for (field = strtok_r(fields + 1, " \n", &saveptr); field != NULL; field = strtok_r(NULL, " \n", &saveptr), number++) {
+        if (number == 4) {
+            *ppid = atoi(field);
+        } else if (number == 39) {
+            *last_cpu = atoi(field);
+            return true;
+        }
+    }
+    procfs_counters.parse_failures++;
+    return false;
+}
+
+/* Function to tell shared memory mappings from other file mappings in numa_maps */
+static bool numa_maps_is_shmem(const char *file) {
+    /* MAP_SHARED|MAP_ANONYMOUS shows up as /dev/zero, System V segments as /SYSV<key>, POSIX ones under /dev/shm */
+    return strncmp(file, "/dev/zero", 9) == 0 || strncmp(file, "/SYSV", 5) == 0 ||
+           strncmp(file, "/dev/shm/", 9) == 0 || strncmp(file, "/memfd:", 7) == 0 ||
+           strncmp(file, "/dev/hugepages/", 15) == 0 || strncmp(file, "/anon_hugepage", 14) == 0;
+}
+
+/* Function to add up the numa_maps of a process per node */
+int procfs_read_numa_maps(int pid, NumaNodeUsage *nodes, int max_nodes) {
+    char path[PATH_MAX];
+    FILE *file;
+    char *line = NULL;
+    size_t size = 0;
+    int nnodes = 0;
+
+    snprintf(path, sizeof(path), "%s/%d/numa_maps", procfs_root(), pid);
+    file = procfs_fopen(path);
+    if (file == NULL) {
+        if (errno == ENOENT || errno == ESRCH) {
+            procfs_counters.vanished++;
+        }
+        return -1;
+    }
+
+    /* "<address> <policy> [file=<path>|anon=<n>|heap|stack] ... N<node>=<pages> ... kernelpagesize_kB=<kb>" */
+    while (getline(&line, &size, file) > 0) {
+        unsigned long long pages[PROCFS_MAX_NUMA_NODES];
+        unsigned long long page_kb = 4;
+        bool shmem = false;
+        bool mapped_file = false;
+        bool any = false;
+        char *token;
+        char *saveptr;
+        int node;
+
+        memset(pages, 0, sizeof(pages));
+        for (token = strtok_r(line, " \n", &saveptr); token != NULL; token = strtok_r(NULL, " \n", &saveptr)) {
+            if (strncmp(token, "file=", 5) == 0) {
+                mapped_file = true;
+                shmem = numa_maps_is_shmem(token + 5);
+            } else if (strncmp(token, "kernelpagesize_kB=", 18) == 0) {
+                page_kb = strtoull(token + 18, NULL, 10);
+            } else if (token[0] == 'N' && isdigit((unsigned char) token[1])) {
+                char *end;
+                unsigned long long count;
+
+                node = (int) strtol(token + 1, &end, 10);
+                if (*end != '=') {
+                    continue;
+                }
+                count = strtoull(end + 1, NULL, 10);
+                if (node < max_nodes && node < PROCFS_MAX_NUMA_NODES) {
+                    pages[node] += count;
+                    any = true;
+                }
+            }
+        }
+        if (!any) {
+            continue;
+        }
+
+        for (node = 0; node < max_nodes && node < PROCFS_MAX_NUMA_NODES; node++) {
+            unsigned long long kb = pages[node] * page_kb;
+
+            if (pages[node] == 0) {
+                continue;
+            }
+            if (shmem) {
+                nodes[node].shmem_kb += kb;
+            } else if (mapped_file) {
+                nodes[node].file_kb += kb;
+            } else {
+                nodes[node].anon_kb += kb;
+            }
+            if (node >= nnodes) {
+                nnodes = node + 1;
+            }
+        }
+    }
+
+    free(line);
+    procfs_fclose(file);
+    return nnodes;
+}
+
+/* Function to order NUMA nodes by number */
+static int numa_node_compare(const void *a, const void *b) {
+    return *(const int *) a - *(const int *) b;
+}
+
+/* Function to read the CPUs and memory of one NUMA node */
+static void sysfs_read_numa_node(int node, NumaNodeInfo *info) {
+    char path[PATH_MAX];
+    char line[256];
+    FILE *file;
+
+    memset(info, 0, sizeof(*info));
+    info->node = node;
+
+    snprintf(path, sizeof(path), "%s/devices/system/node/node%d/cpulist", sysfs_root(), node);
+    file = procfs_fopen(path);
+    if (file != NULL) {
+        if (fgets(info->cpulist, sizeof(info->cpulist), file) != NULL) {
+            info->cpulist[strcspn(info->cpulist, "\n")] = '\0';
+        }
+        procfs_fclose(file);
+    }
+
+    /* "Node 0 MemTotal:       32768000 kB" */
+    snprintf(path, sizeof(path), "%s/devices/system/node/node%d/meminfo", sysfs_root(), node);
+    file = procfs_fopen(path);
+    if (file != NULL) {
+        while (fgets(line, sizeof(line), file)) {
+            char name[32];
+            unsigned long long value;
+
+            if (sscanf(line, "Node %*d %31[^:]: %llu", name, &value) != 2) {
+                continue;
+            }
+            if (strcmp(name, "MemTotal") == 0) {
+                info->total_kb = value;
+            } else if (strcmp(name, "MemFree") == 0) {
+                info->free_kb = value;
+            } else if (strcmp(name, "MemUsed") == 0) {
+                info->used_kb = value;
+            }
+        }
+        procfs_fclose(file);
+    }
+}
+
+/* Function to read the NUMA nodes and their memory from sysfs */
+int sysfs_read_numa_nodes(NumaNodeInfo *nodes, int max_nodes) {
+    char path[PATH_MAX];
+    DIR *dir;
+    struct dirent *ent;
+    int *numbers;
+    int capacity = 64;
+    int found = 0;
+    int count;
+    int i;
+
+    snprintf(path, sizeof(path), "%s/devices/system/node", sysfs_root());
+    dir = opendir(path);
+    if (dir == NULL) {
+        return -1;
+    }
+    numbers = malloc(capacity * sizeof(int));
+    if (numbers == NULL) {
+        closedir(dir);
+        return -1;
+    }
+
+    /* readdir() order is arbitrary: list all node numbers, so that the lowest max_nodes are kept */
+    while ((ent = readdir(dir)) != NULL) {
+        char *end;
+        long node;
+
+        if (strncmp(ent->d_name, "node", 4) != 0 || !isdigit((unsigned char) ent->d_name[4])) {
+            continue;
+        }
+        node = strtol(ent->d_name + 4, &end, 10);
+        if (*end != '\0' || node > INT_MAX) {
+            continue;
+        }
+        if (found == capacity) {
+            int *grown = realloc(numbers, capacity * 2 * sizeof(int));
+
+            if (grown == NULL) {
+                break;
+            }
+            numbers = grown;
+            capacity *= 2;
+        }
+        numbers[found++] = (int) node;
+    }
+    closedir(dir);
+
+    qsort(numbers, found, sizeof(int), numa_node_compare);
+    count = found < max_nodes ? found : max_nodes;
+    for (i = 0; i < count; i++) {
+        sysfs_read_numa_node(numbers[i], &nodes[i]);
+    }
+    free(numbers);
+
+    return count;
+}
+
+/* Function to check whether a cpulist contains a CPU */
+bool sysfs_cpulist_contains(const char *cpulist, int cpu) {
+    const char *pos = cpulist;
+
+    while (*pos != '\0') {
+        char *end;
+        long first = strtol(pos, &end, 10);
+        long last = first;
+
+        if (end == pos) {
+            return false;
+        }
+        if (*end == '-') {
+            pos = end + 1;
+            last = strtol(pos, &end, 10);
+        }
+        if (cpu >= first && cpu <= last) {
+            return true;
+        }
+        pos = (*end == ',') ? end + 1 : end;
+        if (*end != ',') {
+            break;
+        }
+    }
+    return false;
+}
+
+/* Function to read every field of /proc/meminfo */
+int procfs_read_meminfo(MeminfoField *fields, int max_fields) {
+    char path[PATH_MAX];
+    char line[256];
+    FILE *file;
+    int count = 0;
+
+    snprintf(path, sizeof(path), "%s/meminfo", procfs_root());
+    file = procfs_fopen(path);
+    if (file == NULL) {
+        return -1;
+    }
+
+    while (count < max_fields && fgets(line, sizeof(line), file)) {
+        MeminfoField *field = &fields[count];
+        char unit[8] = "";
+
+        if (sscanf(line, "%31[^:]: %llu %7s", field->name, &field->value, unit) < 2) {
+            procfs_counters.parse_failures++;
+            continue;
+        }
+        field->in_kb = (strcmp(unit, "kB") == 0);
+        count++;
+    }
+
+    procfs_fclose(file);
+    return count;
+}
+
+/* Function to count the processors listed in /proc/cpuinfo */
+int procfs_count_cpus(void) {
+    char path[PATH_MAX];
+    char line[256];
+    FILE *file;
+    int cores = 0;
+
+    snprintf(path, sizeof(path), "%s/cpuinfo", procfs_root());
+    file = procfs_fopen(path);
+    if (file == NULL) {
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), file)) {
+        if (strncmp(line, "processor", 9) == 0) {
+            cores++;
+        }
+    }
+
+    procfs_fclose(file);
+    return cores;
+}
+
+/* Function to clean a string of non-numeric characters (except for '.') */
+static void clean_string(char *str) {
+    char *src = str;
+    char *dst = str;
+    while (*src) {
+        if (isdigit((unsigned char) *src) || *src == '.') {
+            *dst++ = *src;
+        }
+        src++;
+    }
+    *dst = '\0';
+}
+
+/* Function to read the frequency of each core from /proc/cpuinfo */
+int procfs_read_cpu_frequencies(CpuFrequencyInfo *frequencies, int max_cores) {
+    char path[PATH_MAX];
+    char line[256];
+    FILE *file;
+    int core_id = -1;
+    float frequency_mhz = 0.0;
+    int index = 0;
+
+    snprintf(path, sizeof(path), "%s/cpuinfo", procfs_root());
+    file = procfs_fopen(path);
+    if (file == NULL) {
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), file) && index < max_cores) {
+        if (strncmp(line, "processor", 9) == 0) {
+            sscanf(line, "processor : %d", &core_id);
+        } else if (strncmp(line, "cpu MHz", 7) == 0) {
+            char frequency_str[32];
+            if (sscanf(line, "cpu MHz : %31s", frequency_str) == 1) {
+                clean_string(frequency_str); /* Clean the string of non-numeric characters */
+                frequency_mhz = atof(frequency_str); /* Convert to float */
+            } else {
+                frequency_mhz = 0.0; /* Set default value */
+            }
+            if (core_id != -1) {
+                frequencies[index].core_id = core_id;
+                frequencies[index].frequency_mhz = frequency_mhz;
+                index++;
+                core_id = -1;
+            }
+        }
+    }
+
+    procfs_fclose(file);
+    return index;
+}
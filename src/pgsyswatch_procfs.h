@@ -0,0 +1,170 @@
+/* pgsyswatch_procfs.h
+SPDX-License-Identifier: Apache-2.0
+Copyright 2025 Alexander Scheglov */
+#ifndef PGSYSWATCH_PROCFS_H
+#define PGSYSWATCH_PROCFS_H
+
+/*
+ * Readers and parsers for procfs/sysfs files.
+ *
+ * Nothing in here uses the PostgreSQL API (no palloc, no ereport), so these
+ * functions can run in the collector's scan threads and be linked into the
+ * standalone benchmark in bench/. Memory is malloc'd and errors are reported
+ * through return values; the callers in the extension turn them into ereports.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/* Define a structure to store process information */
+typedef struct {
+    int pid;                        /* Process ID */
+    char *command;                  /* Command that started the process */
+    char state;                     /* Process state (single letter: R, S, D, Z, etc.) */
+    float res_mb;                   /* Resident memory usage in MB */
+    float virt_mb;                  /* Virtual memory usage in MB */
+    float swap_mb;                  /* Swap usage in MB */
+    unsigned long long utime;       /* Time spent in user mode */
+    unsigned long long stime;       /* Time spent in system mode */
+    float cpu_usage;                /* CPU usage percentage */
+    unsigned long read_bytes;       /* Number of bytes read from disk */
+    unsigned long write_bytes;      /* Number of bytes written to disk */
+    int voluntary_ctxt_switches;    /* Number of voluntary context switches */
+    int nonvoluntary_ctxt_switches; /* Number of involuntary context switches */
+    int threads;                    /* Number of threads */
+} ProcessInfo;
+
+/* One interface line of /proc/net/dev */
+typedef struct NetDevInfo {
+    char face[32];                          /* Network interface name */
+    unsigned long long receive_bytes;
+    unsigned long long receive_packets;
+    unsigned long long receive_errs;
+    unsigned long long receive_drop;
+    unsigned long long transmit_bytes;
+    unsigned long long transmit_packets;
+    unsigned long long transmit_errs;
+    unsigned long long transmit_drop;
+} NetDevInfo;
+
+/* Final accounting of an exiting process, see procfs_read_exit_info() */
+typedef struct ProcessExitInfo {
+    int ppid;
+    char comm[16];                          /* Executable name, as in /proc/[pid]/stat */
+    unsigned long long utime;               /* Ticks, dead threads included */
+    unsigned long long stime;
+    unsigned long long starttime;           /* Ticks after boot */
+    unsigned long long read_bytes;
+    unsigned long long write_bytes;
+    bool have_stat;
+    bool have_io;                           /* io needs ptrace access: own processes only */
+} ProcessExitInfo;
+
+/* Most NUMA nodes reported on; nodes with a higher number are ignored */
+#define PROCFS_MAX_NUMA_NODES 64
+
+/* Memory of a process on one NUMA node, from /proc/[pid]/numa_maps */
+typedef struct NumaNodeUsage {
+    unsigned long long anon_kb;             /* Private anonymous: heap, stack, work_mem */
+    unsigned long long file_kb;             /* Mapped files: binaries, libraries */
+    unsigned long long shmem_kb;            /* Shared memory: shared_buffers, DSM segments */
+} NumaNodeUsage;
+
+/* One NUMA node, from /sys/devices/system/node/node[N] */
+typedef struct NumaNodeInfo {
+    int node;
+    char cpulist[256];                      /* CPUs of the node, e.g. "0-15,32-47" */
+    unsigned long long total_kb;
+    unsigned long long free_kb;
+    unsigned long long used_kb;
+} NumaNodeInfo;
+
+/* One "Name:   value [kB]" line of /proc/meminfo */
+typedef struct MeminfoField {
+    char name[32];
+    unsigned long long value;
+    bool in_kb;                             /* false for counts such as HugePages_Total */
+} MeminfoField;
+
+/* More fields than any kernel reports in /proc/meminfo */
+#define PROCFS_MEMINFO_MAX_FIELDS 128
+
+typedef struct CpuFrequencyInfo {
+    int core_id; 
+    float frequency_mhz;
+} CpuFrequencyInfo;
+
+/*
+ * Work done by the readers below, counted per thread. A collector zeroes the
+ * counters before a scan and publishes them afterwards (pgsyswatch_stats.c);
+ * scan threads hand theirs over to the backend before they exit.
+ */
+typedef struct ProcfsCounters {
+    unsigned long long files_opened;
+    unsigned long long bytes_read;          /* Bytes consumed by the parsers */
+    unsigned long long parse_failures;
+    unsigned long long vanished;            /* Processes that exited between listing and reading */
+} ProcfsCounters;
+
+extern __thread ProcfsCounters procfs_counters;
+
+/* Add the counters in from to into */
+void procfs_counters_add(ProcfsCounters *into, const ProcfsCounters *from);
+
+/* fopen()/fclose() for procfs files, maintaining procfs_counters */
+FILE *procfs_fopen(const char *path);
+void procfs_fclose(FILE *file);
+
+/* Roots of procfs and sysfs (GUCs pgsyswatch.proc_root and pgsyswatch.sys_root) */
+extern char *pgsyswatch_proc_root;
+extern char *pgsyswatch_sys_root;
+const char *procfs_root(void);
+const char *sysfs_root(void);
+
+/* Declare the function get_process_info; command is malloc'd */
+ProcessInfo get_process_info(int pid);
+
+/*
+ * Collect get_process_info() for a list of PIDs, splitting the work across
+ * nthreads threads when that pays off (pgsyswatch_scan.c). Returns a malloc'd
+ * array in PID list order, with malloc'd commands; NULL if out of memory.
+ */
+ProcessInfo *procfs_scan_processes(const int *pids, int npids, int nthreads);
+
+/* Read what a process used, while it exits (or as a zombie); false if it is already reaped */
+bool procfs_read_exit_info(int pid, ProcessExitInfo *info);
+
+/* List the PIDs under the proc root into a malloc'd array; -1 if the root cannot be opened */
+int procfs_read_pids(int **pids);
+
+/* Read the interface lines of /proc/net/dev into a malloc'd string; NULL if it cannot be read */
+char *procfs_read_net_dev(void);
+
+/* Parse one interface line of /proc/net/dev */
+bool procfs_parse_net_dev_line(const char *line, NetDevInfo *info);
+
+/* Read the parent and the CPU a process last ran on (/proc/[pid]/stat fields 4 and 39) */
+bool procfs_read_cpu_placement(int pid, int *ppid, int *last_cpu);
+
+/*
+ * Add up /proc/[pid]/numa_maps per node into nodes[0..max_nodes-1], which
+ * the caller zeroes; returns the highest node seen + 1, -1 if unreadable.
+ */
+int procfs_read_numa_maps(int pid, NumaNodeUsage *nodes, int max_nodes);
+
+/* Read the lowest-numbered max_nodes NUMA nodes under the sysfs root, by node number; -1 if there is no node directory */
+int sysfs_read_numa_nodes(NumaNodeInfo *nodes, int max_nodes);
+
+/* Check whether a cpulist such as "0-3,8-11" contains cpu */
+bool sysfs_cpulist_contains(const char *cpulist, int cpu);
+
+/* Read up to max_fields lines of /proc/meminfo, in file order; -1 if it cannot be opened */
+int procfs_read_meminfo(MeminfoField *fields, int max_fields);
+
+/* Count the processors in /proc/cpuinfo; -1 if it cannot be opened */
+int procfs_count_cpus(void);
+
+/* Read up to max_cores core frequencies from /proc/cpuinfo; -1 if it cannot be opened */
+int procfs_read_cpu_frequencies(CpuFrequencyInfo *frequencies, int max_cores);
+
+#endif  /* PGSYSWATCH_PROCFS_H */
@@ -0,0 +1,179 @@
+/* src/pgsyswatch_scan.c
+SPDX-License-Identifier: Apache-2.0
+Copyright 2025 Alexander Scheglov */
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pgsyswatch_procfs.h"
+
+/*
+ * Multi-threaded /proc harvesting.
+ *
+ * The PID list is split into one contiguous range per thread, and every range
+ * into chunks of SCAN_CHUNK_PIDS. A thread claims chunks of its own range
+ * through an atomic cursor; once its range is exhausted it steals chunks from
+ * the other ranges through the same cursors. A thread stuck on a D-state
+ * process whose /proc reads stall thereby only holds up the rest of its
+ * current chunk.
+ *
+ * Like the rest of the procfs layer this file does not use the PostgreSQL
+ * API, so that the scan can be linked into the benchmark in bench/. Every
+ * range owns a result slab that starts on its own cache line; the calling
+ * thread participates as thread 0 and gathers the slabs after all threads
+ * have been joined.
+ */
+
+/* Number of PIDs claimed at a time */
+#define SCAN_CHUNK_PIDS 16
+/* Below this many PIDs the threads cost more than they save */
+#define SCAN_PARALLEL_MIN_PIDS 256
+/* Upper bound on the number of threads */
+#define SCAN_MAX_THREADS 256
+/* Alignment of the ranges and slabs, against false sharing */
+#define SCAN_CACHE_LINE 128
+
+#define SCAN_ALIGN(size) (((size) + SCAN_CACHE_LINE - 1) & ~((size_t) SCAN_CACHE_LINE - 1))
+
+typedef struct ScanRange {
+    const int *pids;            /* First PID of the range */
+    ProcessInfo *slab;          /* Results, one per PID of the range */
+    int npids;
+    int nchunks;
+    int next_chunk;             /* Claimed with __atomic_fetch_add */
+} __attribute__((aligned(SCAN_CACHE_LINE))) ScanRange;
+
+typedef struct ScanThread {
+    pthread_t thread;
+    int id;
+    int nranges;
+    ScanRange *ranges;
+    ProcfsCounters counters;    /* The thread's work counters, handed over on exit */
+} ScanThread;
+
+/* Function to process one claimed chunk of a range */
+static void scan_chunk(ScanRange *range, int chunk) {
+    int first = chunk * SCAN_CHUNK_PIDS;
+    int last = first + SCAN_CHUNK_PIDS < range->npids ? first + SCAN_CHUNK_PIDS : range->npids;
+    int i;
+
+    for (i = first; i < last; i++) {
+        range->slab[i] = get_process_info(range->pids[i]);
+    }
+}
+
+/* Function to drain the own range, then steal chunks from the others */
+static void *scan_thread_main(void *arg) {
+    ScanThread *self = (ScanThread *) arg;
+    int n;
+
+    for (n = 0; n < self->nranges; n++) {
+        ScanRange *range = &self->ranges[(self->id + n) % self->nranges];
+        int chunk;
+
+        while ((chunk = __atomic_fetch_add(&range->next_chunk, 1, __ATOMIC_RELAXED)) < range->nchunks) {
+            scan_chunk(range, chunk);
+        }
+    }
+    self->counters = procfs_counters;
+    return NULL;
+}
+
+/* Function to collect process information for a list of PIDs, using a pool of threads if asked to */
+ProcessInfo *procfs_scan_processes(const int *pids, int npids, int nthreads) {
+    ScanRange *ranges;
+    ScanThread *threads;
+    ProcessInfo *processes;
+    char *slab_space;
+    size_t slab_size;
+    sigset_t all_signals;
+    sigset_t saved_signals;
+    int per_range;
+    int i;
+    int j;
+    int count = 0;
+
+    processes = (ProcessInfo *) malloc((npids > 0 ? npids : 1) * sizeof(ProcessInfo));
+    if (processes == NULL)
+        return NULL;
+
+    if (nthreads > SCAN_MAX_THREADS) {
+        nthreads = SCAN_MAX_THREADS;
+    }
+    if (nthreads > npids / SCAN_CHUNK_PIDS) {
+        nthreads = npids / SCAN_CHUNK_PIDS;
+    }
+    if (nthreads < 2 || npids < SCAN_PARALLEL_MIN_PIDS) {
+        for (i = 0; i < npids; i++) {
+            processes[i] = get_process_info(pids[i]);
+        }
+        return processes;
+    }
+
+    /* Allocate everything the threads touch up front */
+    per_range = (npids + nthreads - 1) / nthreads;
+    slab_size = SCAN_ALIGN(per_range * sizeof(ProcessInfo));
+    ranges = (ScanRange *) aligned_alloc(SCAN_CACHE_LINE, SCAN_ALIGN(nthreads * sizeof(ScanRange)));
+    threads = (ScanThread *) calloc(nthreads, sizeof(ScanThread));
+    slab_space = (char *) aligned_alloc(SCAN_CACHE_LINE, nthreads * slab_size);
+    if (ranges == NULL || threads == NULL || slab_space == NULL) {
+        free(ranges);
+        free(threads);
+        free(slab_space);
+        free(processes);
+        return NULL;
+    }
+    memset(ranges, 0, nthreads * sizeof(ScanRange));
+
+    for (i = 0; i < nthreads; i++) {
+        ScanRange *range = &ranges[i];
+        int first = i * per_range;
+
+        range->pids = pids + first;
+        range->npids = npids - first < per_range ? npids - first : per_range;
+        if (range->npids < 0) {
+            range->npids = 0;
+        }
+        range->nchunks = (range->npids + SCAN_CHUNK_PIDS - 1) / SCAN_CHUNK_PIDS;
+        range->slab = (ProcessInfo *) (slab_space + i * slab_size);
+
+        threads[i].id = i;
+        threads[i].nranges = nthreads;
+        threads[i].ranges = ranges;
+    }
+
+    /* Threads must never run the caller's signal handlers: start them with all signals blocked */
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_SETMASK, &all_signals, &saved_signals);
+    for (i = 1; i < nthreads; i++) {
+        if (pthread_create(&threads[i].thread, NULL, scan_thread_main, &threads[i]) != 0) {
+            /* Its range gets stolen by the threads that did start */
+            threads[i].id = -1;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &saved_signals, NULL);
+
+    /* The caller is thread 0 */
+    scan_thread_main(&threads[0]);
+
+    for (i = 1; i < nthreads; i++) {
+        if (threads[i].id >= 0) {
+            pthread_join(threads[i].thread, NULL);
+            procfs_counters_add(&procfs_counters, &threads[i].counters);
+        }
+    }
+
+    /* Gather the slabs in PID list order */
+    for (i = 0; i < nthreads; i++) {
+        for (j = 0; j < ranges[i].npids; j++) {
+            processes[count++] = ranges[i].slab[j];
+        }
+    }
+
+    free(ranges);
+    free(threads);
+    free(slab_space);
+    return processes;
+}
@@ -0,0 +1,954 @@
+/* src/pgsyswatch_spool.c
+SPDX-License-Identifier: Apache-2.0
+Copyright 2025 Alexander Scheglov */
+#include "postgres.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "access/xact.h"
+#include "catalog/pg_type.h"
+#include "port/pg_crc32c.h"
+#include "storage/fd.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+#include "utils/snapmgr.h"
+#include "utils/timestamp.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pgsyswatch_spool.h"
+
+/*
+ * Local spool of samples that could not be stored.
+ *
+ * When an insert fails or the server is in recovery, the collector appends
+ * the sample to a segment file in pgsyswatch.spool_directory instead; once
+ * inserts succeed again the segments are replayed, oldest first, with bulk
+ * inserts of up to pgsyswatch.spool_replay_batch rows. Live samples take
+ * the same path: they are encoded first and inserted from their encoding.
+ *
+ * A segment is a file of pgsyswatch.spool_segment_size bytes, allocated up
+ * front and written through mmap(): a SpoolSegmentHeader followed by
+ * records. A record is a SpoolRecordHeader, a null bitmap and the non-null
+ * values in column order without padding (4 or 8 bytes per number, a 4
+ * byte length and the bytes of a text). The CRC-32C covers everything after
+ * the crc field, so a record torn by a crash ends its segment, just like
+ * the zero length of the space after the last record does. Segments are
+ * named after their sequence number; beyond pgsyswatch.spool_max_segments
+ * the oldest are dropped, with a WARNING the first time since the spool was
+ * last emptied.
+ *
+ * A standby that is never promoted would spool until that cap and then
+ * keep rotating, so samples taken during recovery are only spooled with
+ * pgsyswatch.spool_during_recovery, for standbys meant to take over.
+ *
+ * Replay is at least once: a segment is removed after the transaction that
+ * inserted its rows has committed, so a crash in between inserts it again.
+ * A segment whose replay fails SPOOL_MAX_REPLAY_FAILURES times in a row (a
+ * changed table, a constraint, a record that decodes but does not insert)
+ * is renamed to <name>.bad and left for inspection, so that it cannot hold
+ * up the segments behind it.
+ */
+
+/* GUC variables */
+char *pgsyswatch_spool_directory = NULL;      /* empty: samples that cannot be stored are dropped */
+int pgsyswatch_spool_segment_size = 16384;    /* kB */
+int pgsyswatch_spool_max_segments = 64;
+int pgsyswatch_spool_replay_batch = 10000;    /* rows per bulk insert */
+bool pgsyswatch_spool_during_recovery = false;
+
+#define SPOOL_MAGIC 0x53575350      /* "PSWS" */
+#define SPOOL_VERSION 1
+
+typedef struct SpoolSegmentHeader {
+    uint32 magic;
+    uint32 version;
+    uint64 seqno;
+    uint64 size;                /* Size the segment was allocated with */
+} SpoolSegmentHeader;
+
+#define SPOOL_SEGMENT_DATA_OFFSET MAXALIGN(sizeof(SpoolSegmentHeader))
+
+typedef struct SpoolRecordHeader {
+    uint32 length;              /* Bytes of the record, header included; 0 ends the segment */
+    pg_crc32c crc;              /* CRC-32C of the rest of the record */
+    uint16 table;               /* Index into the table array */
+    uint16 ncolumns;
+} SpoolRecordHeader;
+
+#define SPOOL_RECORD_CRC_OFFSET offsetof(SpoolRecordHeader, table)
+
+/* How values of each SpoolColumnType are passed to the bulk insert */
+typedef struct SpoolTypeInfo {
+    Oid type;
+    Oid array_type;
+    int16 typlen;
+    bool typbyval;
+    char typalign;
+} SpoolTypeInfo;
+
+static const SpoolTypeInfo spool_types[] = {
+    [SPOOL_INT4] = {INT4OID, INT4ARRAYOID, sizeof(int32), true, TYPALIGN_INT},
+    [SPOOL_INT8] = {INT8OID, INT8ARRAYOID, sizeof(int64), FLOAT8PASSBYVAL, TYPALIGN_DOUBLE},
+    [SPOOL_FLOAT4] = {FLOAT4OID, FLOAT4ARRAYOID, sizeof(float4), true, TYPALIGN_INT},
+    [SPOOL_FLOAT8] = {FLOAT8OID, FLOAT8ARRAYOID, sizeof(float8), FLOAT8PASSBYVAL, TYPALIGN_DOUBLE},
+    [SPOOL_TIMESTAMP] = {TIMESTAMPOID, TIMESTAMPARRAYOID, sizeof(Timestamp), FLOAT8PASSBYVAL, TYPALIGN_DOUBLE},
+    [SPOOL_TEXT] = {TEXTOID, TEXTARRAYOID, -1, false, TYPALIGN_INT},
+};
+
+/* Rows of one table waiting for their bulk insert */
+typedef struct SpoolBatch {
+    const SpoolTable *table;    /* NULL until the first row arrives */
+    char *insert_sql;
+    Oid argtypes[SPOOL_MAX_COLUMNS];
+    int nrows;
+    int capacity;
+    Datum *values;              /* capacity rows of table->ncolumns */
+    bool *nulls;
+    MemoryContext rows_context; /* Text values and arrays, reset after every insert */
+} SpoolBatch;
+
+/* The segment samples are appended to, NULL if none is open */
+static char *spool_map = NULL;
+static Size spool_map_size = 0;
+static Size spool_write_pos = 0;
+static uint64 spool_seqno = 0;
+
+/* Whether segments exist: -1 unknown, 0 no, 1 yes */
+static int spool_has_segments = -1;
+
+/* A segment was dropped to the cap since the spool was last emptied */
+static bool spool_warned_dropping = false;
+
+/* Failed replays a segment gets before it is set aside */
+#define SPOOL_MAX_REPLAY_FAILURES 3
+
+/* Segments whose last replays failed, in TopMemoryContext */
+typedef struct SpoolReplayFailure {
+    uint64 seqno;
+    int failures;
+} SpoolReplayFailure;
+
+static SpoolReplayFailure *spool_failures = NULL;
+static int spool_nfailures = 0;
+static int spool_failures_capacity = 0;
+
+/* Function to define the spool GUCs */
+void pgsyswatch_spool_init(void) {
+    DefineCustomStringVariable("pgsyswatch.spool_directory",
+                               "Directory the collector spools samples to while they cannot be stored.",
+                               "Relative paths are relative to the data directory. Empty disables the spool.",
+                               &pgsyswatch_spool_directory,
+                               "pgsyswatch_spool",
+                               PGC_SIGHUP,
+                               0,
+                               NULL, NULL, NULL);
+
+    DefineCustomIntVariable("pgsyswatch.spool_segment_size",
+                            "Size of one spool segment file.",
+                            NULL,
+                            &pgsyswatch_spool_segment_size,
+                            16384, 1024, 1048576,
+                            PGC_SIGHUP,
+                            GUC_UNIT_KB,
+                            NULL, NULL, NULL);
+
+    DefineCustomIntVariable("pgsyswatch.spool_max_segments",
+                            "Number of spool segments kept; beyond it the oldest are dropped.",
+                            NULL,
+                            &pgsyswatch_spool_max_segments,
+                            64, 1, INT_MAX,
+                            PGC_SIGHUP,
+                            0,
+                            NULL, NULL, NULL);
+
+    DefineCustomBoolVariable("pgsyswatch.spool_during_recovery",
+                             "Spool the samples taken while the server is in recovery.",
+                             "For standbys that may be promoted; the samples are stored once the server accepts writes.",
+                             &pgsyswatch_spool_during_recovery,
+                             false,
+                             PGC_SIGHUP,
+                             0,
+                             NULL, NULL, NULL);
+
+    DefineCustomIntVariable("pgsyswatch.spool_replay_batch",
+                            "Number of rows per bulk insert when the spool is replayed.",
+                            NULL,
+                            &pgsyswatch_spool_replay_batch,
+                            10000, 1, 1000000,
+                            PGC_SIGHUP,
+                            0,
+                            NULL, NULL, NULL);
+}
+
+/* Function to check whether spooling is configured */
+static bool spool_enabled(void) {
+    return pgsyswatch_spool_directory != NULL && pgsyswatch_spool_directory[0] != '\0';
+}
+
+/* Function to build the path of a segment */
+static void spool_segment_path(char *path, uint64 seqno) {
+    snprintf(path, MAXPGPATH, "%s/%016llX.spool", pgsyswatch_spool_directory, (unsigned long long) seqno);
+}
+
+/* Function to order sequence numbers for qsort() */
+static int spool_seqno_cmp(const void *a, const void *b) {
+    uint64 left = *(const uint64 *) a;
+    uint64 right = *(const uint64 *) b;
+
+    return (left > right) - (left < right);
+}
+
+/* Function to list the sequence numbers of the existing segments, oldest first */
+static int spool_list_segments(uint64 **seqnos) {
+    DIR *dir;
+    struct dirent *de;
+    int capacity = 16;
+    int count = 0;
+
+    *seqnos = (uint64 *) palloc(capacity * sizeof(uint64));
+
+    dir = AllocateDir(pgsyswatch_spool_directory);
+    if (dir == NULL) {
+        if (errno != ENOENT) {
+            ereport(WARNING,
+                    (errcode_for_file_access(),
+                     errmsg("pgsyswatch spool: could not open directory \"%s\": %m", pgsyswatch_spool_directory)));
+        }
+        return 0;
+    }
+
+    while ((de = ReadDirExtended(dir, pgsyswatch_spool_directory, WARNING)) != NULL) {
+        uint64 seqno;
+
+        /* Exactly 16 hex digits and ".spool": quarantined "*.spool.bad" and strays are not segments */
+        if (strlen(de->d_name) != 22 || strspn(de->d_name, "0123456789ABCDEF") != 16 ||
+            strcmp(de->d_name + 16, ".spool") != 0)
+            continue;
+        seqno = strtoull(de->d_name, NULL, 16);
+
+        if (count >= capacity) {
+            capacity *= 2;
+            *seqnos = (uint64 *) repalloc(*seqnos, capacity * sizeof(uint64));
+        }
+        (*seqnos)[count++] = seqno;
+    }
+    FreeDir(dir);
+
+    qsort(*seqnos, count, sizeof(uint64), spool_seqno_cmp);
+    return count;
+}
+
+/* Function to drop the oldest segments beyond pgsyswatch.spool_max_segments */
+static void spool_enforce_max_segments(void) {
+    uint64 *seqnos;
+    int count = spool_list_segments(&seqnos);
+    int i;
+
+    for (i = 0; i < count - pgsyswatch_spool_max_segments; i++) {
+        char path[MAXPGPATH];
+
+        spool_segment_path(path, seqnos[i]);
+        if (unlink(path) != 0 && errno != ENOENT) {
+            ereport(WARNING,
+                    (errcode_for_file_access(),
+                     errmsg("pgsyswatch spool: could not remove \"%s\": %m", path)));
+        } else {
+            /* Samples are being lost: say so loudly once, then quietly for each further segment */
+            ereport(spool_warned_dropping ? LOG : WARNING,
+                    (errmsg("pgsyswatch spool: dropped \"%s\", pgsyswatch.spool_max_segments (%d) reached",
+                            path, pgsyswatch_spool_max_segments),
+                     spool_warned_dropping ? 0 : errhint("Raise pgsyswatch.spool_max_segments or pgsyswatch.spool_segment_size to keep more samples.")));
+            spool_warned_dropping = true;
+        }
+    }
+    pfree(seqnos);
+}
+
+/* Function to create and map the next segment; false (with a WARNING) on failure */
+static bool spool_open_segment(void) {
+    Size size = (Size) pgsyswatch_spool_segment_size * 1024;
+    SpoolSegmentHeader header;
+    char path[MAXPGPATH];
+    uint64 *seqnos;
+    int count;
+    int fd;
+    int rc;
+    char *map;
+
+    if (MakePGDirectory(pgsyswatch_spool_directory) < 0 && errno != EEXIST) {
+        ereport(WARNING,
+                (errcode_for_file_access(),
+                 errmsg("pgsyswatch spool: could not create directory \"%s\": %m", pgsyswatch_spool_directory)));
+        return false;
+    }
+
+    /* Segments of an earlier run are left alone and replayed; always start a fresh one */
+    count = spool_list_segments(&seqnos);
+    spool_seqno = count > 0 ? seqnos[count - 1] + 1 : 1;
+    pfree(seqnos);
+
+    spool_segment_path(path, spool_seqno);
+    fd = BasicOpenFile(path, O_RDWR | O_CREAT | O_EXCL | PG_BINARY);
+    if (fd < 0) {
+        ereport(WARNING,
+                (errcode_for_file_access(),
+                 errmsg("pgsyswatch spool: could not create \"%s\": %m", path)));
+        return false;
+    }
+
+    /* Allocate all blocks now: storing into a hole on a full file system would raise SIGBUS */
+    rc = posix_fallocate(fd, 0, size);
+    if (rc == 0) {
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        rc = (map == MAP_FAILED) ? errno : 0;
+    }
+    close(fd);
+    if (rc != 0) {
+        errno = rc;
+        ereport(WARNING,
+                (errcode_for_file_access(),
+                 errmsg("pgsyswatch spool: could not allocate %zu bytes for \"%s\": %m", size, path)));
+        unlink(path);
+        return false;
+    }
+
+    header.magic = SPOOL_MAGIC;
+    header.version = SPOOL_VERSION;
+    header.seqno = spool_seqno;
+    header.size = size;
+    memcpy(map, &header, sizeof(header));
+
+    spool_map = map;
+    spool_map_size = size;
+    spool_write_pos = SPOOL_SEGMENT_DATA_OFFSET;
+    spool_has_segments = 1;
+
+    fsync_fname_ext(pgsyswatch_spool_directory, true, false, WARNING);
+    spool_enforce_max_segments();
+    return true;
+}
+
+/* Function to flush the open segment from byte from on to disk */
+static bool spool_sync(Size from) {
+    Size start = from - from % sysconf(_SC_PAGESIZE);
+
+    if (msync(spool_map + start, spool_write_pos - start, MS_SYNC) != 0) {
+        ereport(WARNING,
+                (errcode_for_file_access(),
+                 errmsg("pgsyswatch spool: could not sync segment %016llX: %m", (unsigned long long) spool_seqno)));
+        return false;
+    }
+    return true;
+}
+
+/* Function to unmap the open segment; everything in it has been synced already */
+static void spool_close_segment(void) {
+    if (spool_map == NULL)
+        return;
+
+    munmap(spool_map, spool_map_size);
+    spool_map = NULL;
+}
+
+/* Function to append a value to the record being encoded */
+static void spool_encode_value(StringInfo buf, SpoolColumnType type, Datum value) {
+    switch (type) {
+        case SPOOL_INT4: {
+            int32 v = DatumGetInt32(value);
+
+            appendBinaryStringInfo(buf, (char *) &v, sizeof(v));
+            break;
+        }
+        case SPOOL_INT8: {
+            int64 v = DatumGetInt64(value);
+
+            appendBinaryStringInfo(buf, (char *) &v, sizeof(v));
+            break;
+        }
+        case SPOOL_FLOAT4: {
+            float4 v = DatumGetFloat4(value);
+
+            appendBinaryStringInfo(buf, (char *) &v, sizeof(v));
+            break;
+        }
+        case SPOOL_FLOAT8: {
+            float8 v = DatumGetFloat8(value);
+
+            appendBinaryStringInfo(buf, (char *) &v, sizeof(v));
+            break;
+        }
+        case SPOOL_TIMESTAMP: {
+            Timestamp v = DatumGetTimestamp(value);
+
+            appendBinaryStringInfo(buf, (char *) &v, sizeof(v));
+            break;
+        }
+        case SPOOL_TEXT: {
+            text *t = DatumGetTextPP(value);
+            uint32 len = VARSIZE_ANY_EXHDR(t);
+
+            appendBinaryStringInfo(buf, (char *) &len, sizeof(len));
+            appendBinaryStringInfo(buf, VARDATA_ANY(t), len);
+            break;
+        }
+    }
+}
+
+/* Function to encode the rows of an SPI result as records */
+void pgsyswatch_spool_encode(StringInfo buf, const SpoolTable *tables, int table,
+                             SPITupleTable *tuptable, uint64 ntuples) {
+    const SpoolTable *target = &tables[table];
+    TupleDesc tupdesc = tuptable->tupdesc;
+    int bitmap_len = (target->ncolumns + 7) / 8;
+    uint64 row;
+    int i;
+
+    /* The record format relies on the query producing the declared columns first; the rest are not stored */
+    if (tupdesc->natts < target->ncolumns) {
+        elog(ERROR, "pgsyswatch spool: query for %s returned %d columns, expected at least %d",
+             target->name, tupdesc->natts, target->ncolumns);
+    }
+    for (i = 0; i < target->ncolumns; i++) {
+        if (TupleDescAttr(tupdesc, i)->atttypid != spool_types[target->columns[i].type].type) {
+            elog(ERROR, "pgsyswatch spool: column %s of the query for %s has type %u, expected %u",
+                 target->columns[i].name, target->name, TupleDescAttr(tupdesc, i)->atttypid,
+                 spool_types[target->columns[i].type].type);
+        }
+    }
+
+    for (row = 0; row < ntuples; row++) {
+        HeapTuple tuple = tuptable->vals[row];
+        SpoolRecordHeader header = {0};
+        int start = buf->len;
+        int bitmap_pos;
+
+        header.table = table;
+        header.ncolumns = target->ncolumns;
+        appendBinaryStringInfo(buf, (char *) &header, sizeof(header));
+        bitmap_pos = buf->len;
+        appendStringInfoSpaces(buf, bitmap_len);
+        memset(buf->data + bitmap_pos, 0, bitmap_len);
+
+        for (i = 0; i < target->ncolumns; i++) {
+            bool isnull;
+            Datum value = SPI_getbinval(tuple, tupdesc, i + 1, &isnull);
+
+            if (isnull) {
+                buf->data[bitmap_pos + i / 8] |= 1 << (i % 8);
+            } else {
+                spool_encode_value(buf, target->columns[i].type, value);
+            }
+        }
+
+        header.length = buf->len - start;
+        INIT_CRC32C(header.crc);
+        COMP_CRC32C(header.crc, buf->data + start + SPOOL_RECORD_CRC_OFFSET, header.length - SPOOL_RECORD_CRC_OFFSET);
+        FIN_CRC32C(header.crc);
+        memcpy(buf->data + start, &header, sizeof(header));
+    }
+}
+
+/*
+ * Function to step to the next record.
+ *
+ * Returns false at the end of the data; *damaged tells whether it ended with
+ * a zero length (or simply ran out) or with a record that does not check out.
+ */
+static bool spool_next_record(const char *data, Size len, Size *offset, const SpoolTable *tables, int ntables,
+                              const char **record, SpoolRecordHeader *header, bool *damaged) {
+    pg_crc32c crc;
+
+    *damaged = false;
+    if (len - *offset < sizeof(SpoolRecordHeader))
+        return false;
+
+    memcpy(header, data + *offset, sizeof(SpoolRecordHeader));
+    if (header->length == 0)
+        return false;
+
+    if (header->length < sizeof(SpoolRecordHeader) || header->length > len - *offset) {
+        *damaged = true;
+        return false;
+    }
+
+    INIT_CRC32C(crc);
+    COMP_CRC32C(crc, data + *offset + SPOOL_RECORD_CRC_OFFSET, header->length - SPOOL_RECORD_CRC_OFFSET);
+    FIN_CRC32C(crc);
+    if (!EQ_CRC32C(crc, header->crc) || header->table >= ntables ||
+        header->ncolumns != tables[header->table].ncolumns) {
+        *damaged = true;
+        return false;
+    }
+
+    *record = data + *offset;
+    *offset += header->length;
+    return true;
+}
+
+/* Function to copy size bytes out of a record, checking its bounds */
+static bool spool_read(const char **pos, const char *end, void *dst, Size size) {
+    if (end - *pos < size)
+        return false;
+    memcpy(dst, *pos, size);
+    *pos += size;
+    return true;
+}
+
+/* Function to decode a record into Datums (text is palloc'd); false if it is malformed */
+static bool spool_decode_record(const char *record, const SpoolRecordHeader *header, const SpoolTable *table,
+                                Datum *values, bool *nulls) {
+    const char *end = record + header->length;
+    const uint8 *bitmap = (const uint8 *) (record + sizeof(SpoolRecordHeader));
+    const char *pos = (const char *) bitmap + (table->ncolumns + 7) / 8;
+    int i;
+
+    if (pos > end)
+        return false;
+
+    for (i = 0; i < table->ncolumns; i++) {
+        nulls[i] = (bitmap[i / 8] >> (i % 8)) & 1;
+        values[i] = (Datum) 0;
+        if (nulls[i])
+            continue;
+
+        switch (table->columns[i].type) {
+            case SPOOL_INT4: {
+                int32 v;
+
+                if (!spool_read(&pos, end, &v, sizeof(v)))
+                    return false;
+                values[i] = Int32GetDatum(v);
+                break;
+            }
+            case SPOOL_INT8: {
+                int64 v;
+
+                if (!spool_read(&pos, end, &v, sizeof(v)))
+                    return false;
+                values[i] = Int64GetDatum(v);
+                break;
+            }
+            case SPOOL_FLOAT4: {
+                float4 v;
+
+                if (!spool_read(&pos, end, &v, sizeof(v)))
+                    return false;
+                values[i] = Float4GetDatum(v);
+                break;
+            }
+            case SPOOL_FLOAT8: {
+                float8 v;
+
+                if (!spool_read(&pos, end, &v, sizeof(v)))
+                    return false;
+                values[i] = Float8GetDatum(v);
+                break;
+            }
+            case SPOOL_TIMESTAMP: {
+                Timestamp v;
+
+                if (!spool_read(&pos, end, &v, sizeof(v)))
+                    return false;
+                values[i] = TimestampGetDatum(v);
+                break;
+            }
+            case SPOOL_TEXT: {
+                uint32 len;
+
+                if (!spool_read(&pos, end, &len, sizeof(len)) || end - pos < len)
+                    return false;
+                values[i] = PointerGetDatum(cstring_to_text_with_len(pos, len));
+                pos += len;
+                break;
+            }
+        }
+    }
+    return pos == end;
+}
+
+/* Function to prepare the batch of a table: INSERT ... SELECT * FROM unnest($1, $2, ...) */
+static void spool_batch_init(SpoolBatch *batch, const SpoolTable *table) {
+    StringInfoData sql;
+    int i;
+
+    batch->table = table;
+    batch->nrows = 0;
+    batch->capacity = pgsyswatch_spool_replay_batch;
+    batch->values = (Datum *) palloc(batch->capacity * table->ncolumns * sizeof(Datum));
+    batch->nulls = (bool *) palloc(batch->capacity * table->ncolumns * sizeof(bool));
+    batch->rows_context = AllocSetContextCreate(CurrentMemoryContext, "pgsyswatch spool batch", ALLOCSET_DEFAULT_SIZES);
+
+    initStringInfo(&sql);
+    appendStringInfo(&sql, "INSERT INTO %s (", table->name);
+    for (i = 0; i < table->ncolumns; i++) {
+        appendStringInfo(&sql, "%s%s", i > 0 ? ", " : "", table->columns[i].name);
+        batch->argtypes[i] = spool_types[table->columns[i].type].array_type;
+    }
+    appendStringInfoString(&sql, ") SELECT * FROM unnest(");
+    for (i = 0; i < table->ncolumns; i++) {
+        appendStringInfo(&sql, "%s$%d", i > 0 ? ", " : "", i + 1);
+    }
+    appendStringInfoChar(&sql, ')');
+    batch->insert_sql = sql.data;
+}
+
+/* Function to insert the rows of a batch with one statement, one array per column */
+static uint64 spool_batch_flush(SpoolBatch *batch) {
+    const SpoolTable *table = batch->table;
+    Datum args[SPOOL_MAX_COLUMNS];
+    char argnulls[SPOOL_MAX_COLUMNS];
+    MemoryContext oldcontext;
+    Datum *elems;
+    bool *elemnulls;
+    int dims[1];
+    int lbs[1] = {1};
+    uint64 inserted = batch->nrows;
+    int ret;
+    int i;
+    int r;
+
+    if (batch->nrows == 0)
+        return 0;
+
+    oldcontext = MemoryContextSwitchTo(batch->rows_context);
+    elems = (Datum *) palloc(batch->nrows * sizeof(Datum));
+    elemnulls = (bool *) palloc(batch->nrows * sizeof(bool));
+    dims[0] = batch->nrows;
+    for (i = 0; i < table->ncolumns; i++) {
+        const SpoolTypeInfo *type = &spool_types[table->columns[i].type];
+
+        for (r = 0; r < batch->nrows; r++) {
+            elems[r] = batch->values[r * table->ncolumns + i];
+            elemnulls[r] = batch->nulls[r * table->ncolumns + i];
+        }
+        args[i] = PointerGetDatum(construct_md_array(elems, elemnulls, 1, dims, lbs,
+                                                     type->type, type->typlen, type->typbyval, type->typalign));
+        argnulls[i] = ' ';
+    }
+    MemoryContextSwitchTo(oldcontext);
+
+    ret = SPI_execute_with_args(batch->insert_sql, table->ncolumns, batch->argtypes, args, argnulls, false, 0);
+    if (ret != SPI_OK_INSERT) {
+        elog(ERROR, "pgsyswatch spool: bulk insert into %s failed: %s", table->name, SPI_result_code_string(ret));
+    }
+
+    batch->nrows = 0;
+    MemoryContextReset(batch->rows_context);
+    return inserted;
+}
+
+/* Function to bulk insert the records in data; source names them in messages */
+static uint64 spool_insert_records(const SpoolTable *tables, int ntables, const char *data, Size len,
+                                   const char *source) {
+    SpoolBatch *batches = (SpoolBatch *) palloc0(ntables * sizeof(SpoolBatch));
+    SpoolRecordHeader header;
+    const char *record;
+    Size offset = 0;
+    bool damaged;
+    uint64 inserted = 0;
+    int i;
+
+    while (spool_next_record(data, len, &offset, tables, ntables, &record, &header, &damaged)) {
+        SpoolBatch *batch = &batches[header.table];
+        MemoryContext oldcontext;
+        bool decoded;
+
+        if (batch->table == NULL) {
+            spool_batch_init(batch, &tables[header.table]);
+        }
+
+        oldcontext = MemoryContextSwitchTo(batch->rows_context);
+        decoded = spool_decode_record(record, &header, batch->table,
+                                      &batch->values[batch->nrows * batch->table->ncolumns],
+                                      &batch->nulls[batch->nrows * batch->table->ncolumns]);
+        MemoryContextSwitchTo(oldcontext);
+        if (!decoded) {
+            offset -= header.length;
+            damaged = true;
+            break;
+        }
+
+        if (++batch->nrows == batch->capacity) {
+            inserted += spool_batch_flush(batch);
+            CHECK_FOR_INTERRUPTS();
+        }
+    }
+
+    if (damaged) {
+        ereport(WARNING,
+                (errmsg("pgsyswatch spool: %s is damaged at byte %zu, the rest of it is skipped", source, offset)));
+    }
+
+    for (i = 0; i < ntables; i++) {
+        if (batches[i].table != NULL) {
+            inserted += spool_batch_flush(&batches[i]);
+            MemoryContextDelete(batches[i].rows_context);
+        }
+    }
+    return inserted;
+}
+
+/* Function to bulk insert encoded records */
+uint64 pgsyswatch_spool_insert(const SpoolTable *tables, int ntables, const char *data, Size len) {
+    return spool_insert_records(tables, ntables, data, len, "the sample");
+}
+
+/* Function to append encoded records to the open segment, rotating as needed, and sync them */
+bool pgsyswatch_spool_append(const SpoolTable *tables, int ntables, const char *data, Size len) {
+    SpoolRecordHeader header;
+    const char *record;
+    Size offset = 0;
+    Size sync_from;
+    bool damaged;
+
+    if (!spool_enabled())
+        return false;
+
+    if (spool_map == NULL && !spool_open_segment())
+        return false;
+
+    sync_from = spool_write_pos;
+    while (spool_next_record(data, len, &offset, tables, ntables, &record, &header, &damaged)) {
+        if (header.length > spool_map_size - SPOOL_SEGMENT_DATA_OFFSET) {
+            ereport(WARNING,
+                    (errmsg("pgsyswatch spool: a row of %u bytes does not fit into a segment of pgsyswatch.spool_segment_size, dropped",
+                            header.length)));
+            continue;
+        }
+
+        if (header.length > spool_map_size - spool_write_pos) {
+            if (!spool_sync(sync_from))
+                return false;
+            spool_close_segment();
+            if (!spool_open_segment())
+                return false;
+            sync_from = spool_write_pos;
+        }
+
+        memcpy(spool_map + spool_write_pos, record, header.length);
+        spool_write_pos += header.length;
+    }
+
+    return spool_sync(sync_from);
+}
+
+/* Function to check whether there are segments to replay */
+bool pgsyswatch_spool_pending(void) {
+    if (!spool_enabled())
+        return false;
+
+    if (spool_has_segments < 0) {
+        uint64 *seqnos;
+
+        spool_has_segments = spool_list_segments(&seqnos) > 0;
+        pfree(seqnos);
+    }
+    return spool_has_segments > 0;
+}
+
+/* Function to insert the rows of one segment (in the caller's transaction) */
+static uint64 spool_replay_segment(const char *path, const SpoolTable *tables, int ntables) {
+    volatile uint64 rows = 0;
+    SpoolSegmentHeader header;
+    struct stat st;
+    char *map;
+    int fd;
+
+    fd = OpenTransientFile(path, O_RDONLY | PG_BINARY);
+    if (fd < 0) {
+        ereport(ERROR,
+                (errcode_for_file_access(),
+                 errmsg("pgsyswatch spool: could not open \"%s\": %m", path)));
+    }
+    if (fstat(fd, &st) != 0) {
+        ereport(ERROR,
+                (errcode_for_file_access(),
+                 errmsg("pgsyswatch spool: could not stat \"%s\": %m", path)));
+    }
+    if (st.st_size < SPOOL_SEGMENT_DATA_OFFSET) {
+        CloseTransientFile(fd);
+        ereport(WARNING,
+                (errmsg("pgsyswatch spool: \"%s\" is truncated, skipped", path)));
+        return 0;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        ereport(ERROR,
+                (errcode_for_file_access(),
+                 errmsg("pgsyswatch spool: could not map \"%s\": %m", path)));
+    }
+    CloseTransientFile(fd);
+
+    PG_TRY();
+    {
+        memcpy(&header, map, sizeof(header));
+        if (header.magic != SPOOL_MAGIC || header.version != SPOOL_VERSION) {
+            ereport(WARNING,
+                    (errmsg("pgsyswatch spool: \"%s\" is not a spool segment of this version, skipped", path)));
+        } else {
+            rows = spool_insert_records(tables, ntables, map + SPOOL_SEGMENT_DATA_OFFSET,
+                                        st.st_size - SPOOL_SEGMENT_DATA_OFFSET, path);
+        }
+    }
+    PG_FINALLY();
+    {
+        munmap(map, st.st_size);
+    }
+    PG_END_TRY();
+
+    return rows;
+}
+
+/* Function to count a failed replay of a segment; returns its failures so far */
+static int spool_note_failure(uint64 seqno) {
+    int i;
+
+    for (i = 0; i < spool_nfailures; i++) {
+        if (spool_failures[i].seqno == seqno)
+            return ++spool_failures[i].failures;
+    }
+
+    if (spool_nfailures == spool_failures_capacity) {
+        spool_failures_capacity = Max(spool_failures_capacity * 2, 8);
+        if (spool_failures == NULL) {
+            spool_failures = (SpoolReplayFailure *) MemoryContextAlloc(TopMemoryContext,
+                                                                       spool_failures_capacity * sizeof(SpoolReplayFailure));
+        } else {
+            spool_failures = (SpoolReplayFailure *) repalloc(spool_failures,
+                                                             spool_failures_capacity * sizeof(SpoolReplayFailure));
+        }
+    }
+    spool_failures[spool_nfailures].seqno = seqno;
+    spool_failures[spool_nfailures].failures = 1;
+    return spool_failures[spool_nfailures++].failures;
+}
+
+/* Function to forget the failures of a segment that was replayed or set aside */
+static void spool_forget_failures(uint64 seqno) {
+    int i;
+
+    for (i = 0; i < spool_nfailures; i++) {
+        if (spool_failures[i].seqno == seqno) {
+            spool_failures[i] = spool_failures[--spool_nfailures];
+            return;
+        }
+    }
+}
+
+/*
+ * Function to handle a failed replay of a segment (its transaction is
+ * aborted already); returns true if the segment is still there to retry.
+ */
+static bool spool_replay_failed(const char *path, uint64 seqno, const char *message) {
+    char bad_path[MAXPGPATH];
+    int failures = spool_note_failure(seqno);
+
+    if (failures < SPOOL_MAX_REPLAY_FAILURES) {
+        ereport(WARNING,
+                (errmsg("pgsyswatch spool: could not replay \"%s\" (attempt %d of %d): %s",
+                        path, failures, SPOOL_MAX_REPLAY_FAILURES, message)));
+        return true;
+    }
+
+    spool_forget_failures(seqno);
+    snprintf(bad_path, sizeof(bad_path), "%s.bad", path);
+    if (rename(path, bad_path) != 0) {
+        ereport(WARNING,
+                (errcode_for_file_access(),
+                 errmsg("pgsyswatch spool: could not rename \"%s\" to \"%s\": %m", path, bad_path)));
+        return true;
+    }
+    ereport(WARNING,
+            (errmsg("pgsyswatch spool: could not replay \"%s\" %d times, moved it to \"%s\": %s",
+                    path, failures, bad_path, message)));
+    return false;
+}
+
+/* Function to replay all segments, oldest first, and remove each once its rows are committed */
+uint64 pgsyswatch_spool_replay(const SpoolTable *tables, int ntables) {
+    MemoryContext context = CurrentMemoryContext;
+    uint64 *seqnos;
+    uint64 total = 0;
+    int remaining = 0;
+    int count;
+    int i;
+
+    if (!pgsyswatch_spool_pending())
+        return 0;
+
+    /* The open segment is replayed as well; the next sample to spool starts a new one */
+    spool_close_segment();
+
+    count = spool_list_segments(&seqnos);
+    for (i = 0; i < count; i++) {
+        char path[MAXPGPATH];
+        volatile uint64 rows = 0;
+        volatile bool replayed = false;
+
+        CHECK_FOR_INTERRUPTS();
+        spool_segment_path(path, seqnos[i]);
+
+        /* Each segment in its own transaction: one that fails must not stop the others */
+        PG_TRY();
+        {
+            SetCurrentStatementStartTimestamp();
+            StartTransactionCommand();
+            SPI_connect();
+            PushActiveSnapshot(GetTransactionSnapshot());
+            pgstat_report_activity(STATE_RUNNING, "pgsyswatch collector: replaying spool");
+
+            rows = spool_replay_segment(path, tables, ntables);
+
+            SPI_finish();
+            PopActiveSnapshot();
+            CommitTransactionCommand();
+            pgstat_report_activity(STATE_IDLE, NULL);
+            replayed = true;
+        }
+        PG_CATCH();
+        {
+            ErrorData *edata;
+
+            MemoryContextSwitchTo(context);
+            edata = CopyErrorData();
+            FlushErrorState();
+            AbortCurrentTransaction();
+            pgstat_report_activity(STATE_IDLE, NULL);
+
+            if (spool_replay_failed(path, seqnos[i], edata->message)) {
+                remaining++;
+            }
+            FreeErrorData(edata);
+        }
+        PG_END_TRY();
+
+        if (!replayed)
+            continue;
+
+        spool_forget_failures(seqnos[i]);
+        if (unlink(path) != 0 && errno != ENOENT) {
+            ereport(WARNING,
+                    (errcode_for_file_access(),
+                     errmsg("pgsyswatch spool: could not remove \"%s\", its rows may be inserted again: %m", path)));
+        }
+        total += rows;
+    }
+    pfree(seqnos);
+
+    spool_has_segments = (remaining > 0);
+    if (remaining == 0) {
+        spool_warned_dropping = false;
+    }
+    return total;
+}
@@ -0,0 +1,69 @@
+/* pgsyswatch_spool.h
+SPDX-License-Identifier: Apache-2.0
+Copyright 2025 Alexander Scheglov */
+#ifndef PGSYSWATCH_SPOOL_H
+#define PGSYSWATCH_SPOOL_H
+
+#include "postgres.h"
+#include "executor/spi.h"
+#include "lib/stringinfo.h"
+
+/* Most columns a spooled table can have */
+#define SPOOL_MAX_COLUMNS 32
+
+/* Column types the spool can encode */
+typedef enum SpoolColumnType {
+    SPOOL_INT4,
+    SPOOL_INT8,
+    SPOOL_FLOAT4,
+    SPOOL_FLOAT8,
+    SPOOL_TIMESTAMP,
+    SPOOL_TEXT
+} SpoolColumnType;
+
+typedef struct SpoolColumn {
+    const char *name;
+    SpoolColumnType type;
+} SpoolColumn;
+
+/*
+ * A table samples are stored in. select_sql produces the rows of one sample,
+ * with the columns below, in that order and of those types, optionally
+ * followed by columns that are read by the detector but not stored. Records
+ * refer to their table by its index in the array passed around below, so
+ * entries may be appended to that array but never reordered.
+ */
+typedef struct SpoolTable {
+    const char *name;
+    const char *select_sql;
+    int ncolumns;
+    const SpoolColumn *columns;
+} SpoolTable;
+
+/* GUC variables */
+extern char *pgsyswatch_spool_directory;
+extern int pgsyswatch_spool_segment_size;
+extern int pgsyswatch_spool_max_segments;
+extern int pgsyswatch_spool_replay_batch;
+extern bool pgsyswatch_spool_during_recovery;
+
+/* Defines GUCs (called from _PG_init) */
+void pgsyswatch_spool_init(void);
+
+/* Encode the rows of an SPI result for tables[table] as spool records appended to buf */
+void pgsyswatch_spool_encode(StringInfo buf, const SpoolTable *tables, int table,
+                             SPITupleTable *tuptable, uint64 ntuples);
+
+/* Bulk insert encoded records (SPI must be connected); returns the number of rows */
+uint64 pgsyswatch_spool_insert(const SpoolTable *tables, int ntables, const char *data, Size len);
+
+/* Append encoded records to the spool; false (with a WARNING) if they could not be made durable */
+bool pgsyswatch_spool_append(const SpoolTable *tables, int ntables, const char *data, Size len);
+
+/* True if spooled records are waiting to be replayed */
+bool pgsyswatch_spool_pending(void);
+
+/* Replay and remove all spooled segments, one transaction each, setting aside those that keep failing (call outside a transaction) */
+uint64 pgsyswatch_spool_replay(const SpoolTable *tables, int ntables);
+
+#endif  /* PGSYSWATCH_SPOOL_H */
@@ -0,0 +1,300 @@
+/* src/pgsyswatch_stats.c
+SPDX-License-Identifier: Apache-2.0
+Copyright 2025 Alexander Scheglov */
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "access/htup_details.h"
+#include "catalog/pg_type.h"
+#include "storage/ipc.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/timestamp.h"
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#include "pgsyswatch_stats.h"
+
+/*
+ * Self-instrumentation.
+ *
+ * Every read of a data source (a proc_monitor_all() scan, one net/dev read,
+ * ...) is accounted here: how many PIDs it visited, how many files it opened
+ * and how many bytes the parsers consumed, how many lines failed to parse,
+ * how many processes exited between the PID listing and the read, and the
+ * wall and CPU time it took, with a latency histogram. Calls answered from
+ * the shared snapshot cache are counted separately. The numbers live in
+ * shared memory when pgsyswatch is in shared_preload_libraries and are
+ * backend-local otherwise; collector_stats() shows them.
+ */
+
+/* Upper bounds of the latency histogram buckets, ms; the last bucket is unbounded */
+static const double stats_latency_bounds_ms[] = {0.1, 0.25, 0.5, 1, 2.5, 5, 10, 25, 50, 100, 250, 1000};
+
+#define STATS_NBUCKETS (lengthof(stats_latency_bounds_ms) + 1)
+
+/* Row names, in PgSysWatchCollector order */
+static const char *const stats_collector_names[PGSYSWATCH_NUM_COLLECTORS] = {
+    "proc_monitor_all",
+    "proc_monitor",
+    "net_monitor",
+    "pg_loadavg",
+    "cpu_frequencies",
+    "system_info",
+    "proc_events",
+    "relation_os_cache",
+    "proc_numa",
+};
+
+typedef struct CollectorStats {
+    slock_t mutex;              /* Protects everything below */
+    uint64 scans;
+    uint64 cache_hits;
+    uint64 pids_visited;
+    uint64 files_opened;
+    uint64 bytes_read;
+    uint64 parse_failures;
+    uint64 vanished;
+    double wall_ms;             /* Totals over all scans */
+    double cpu_ms;
+    double max_wall_ms;
+    uint64 latency[STATS_NBUCKETS];
+    TimestampTz stats_reset;
+} CollectorStats;
+
+typedef struct PgSysWatchStats {
+    CollectorStats collectors[PGSYSWATCH_NUM_COLLECTORS];
+} PgSysWatchStats;
+
+static PgSysWatchStats *pgsyswatch_stats = NULL;
+
+/* Used when pgsyswatch is not preloaded */
+static PgSysWatchStats local_stats;
+
+/* Function to zero the statistics of one collector (call with its mutex held or before it is shared) */
+static void stats_zero(CollectorStats *stats, TimestampTz now) {
+    stats->scans = 0;
+    stats->cache_hits = 0;
+    stats->pids_visited = 0;
+    stats->files_opened = 0;
+    stats->bytes_read = 0;
+    stats->parse_failures = 0;
+    stats->vanished = 0;
+    stats->wall_ms = 0;
+    stats->cpu_ms = 0;
+    stats->max_wall_ms = 0;
+    memset(stats->latency, 0, sizeof(stats->latency));
+    stats->stats_reset = now;
+}
+
+/* Function to initialize a statistics area */
+static void stats_area_init(PgSysWatchStats *area) {
+    TimestampTz now = GetCurrentTimestamp();
+    int i;
+
+    for (i = 0; i < PGSYSWATCH_NUM_COLLECTORS; i++) {
+        SpinLockInit(&area->collectors[i].mutex);
+        stats_zero(&area->collectors[i], now);
+    }
+}
+
+/* Function to return the statistics area in use, falling back to the backend-local one */
+static PgSysWatchStats *stats_area(void) {
+    if (pgsyswatch_stats == NULL) {
+        stats_area_init(&local_stats);
+        pgsyswatch_stats = &local_stats;
+    }
+    return pgsyswatch_stats;
+}
+
+/* Function to reserve shared memory for the statistics */
+void pgsyswatch_stats_shmem_request(void) {
+    RequestAddinShmemSpace(sizeof(PgSysWatchStats));
+}
+
+/* Function to attach to (and on first use initialize) the shared statistics; AddinShmemInitLock is held */
+void pgsyswatch_stats_shmem_startup(void) {
+    bool found;
+
+    pgsyswatch_stats = ShmemInitStruct("pgsyswatch_stats", sizeof(PgSysWatchStats), &found);
+    if (!found) {
+        stats_area_init(pgsyswatch_stats);
+    }
+}
+
+/* Function to compute the milliseconds between two readings of a clock */
+static double stats_elapsed_ms(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1000.0 + (end->tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+/* Function to start accounting a scan */
+void pgsyswatch_stats_scan_begin(CollectorScan *scan, PgSysWatchCollector collector) {
+    scan->collector = collector;
+    memset(&procfs_counters, 0, sizeof(procfs_counters));
+    clock_gettime(CLOCK_MONOTONIC, &scan->wall_start);
+    /* Process-wide, so that the collector's scan threads are included */
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &scan->cpu_start);
+}
+
+/* Function to add a finished scan to the collector's statistics */
+void pgsyswatch_stats_scan_end(CollectorScan *scan, uint64 pids_visited) {
+    CollectorStats *stats = &stats_area()->collectors[scan->collector];
+    struct timespec wall_end;
+    struct timespec cpu_end;
+    double wall_ms;
+    double cpu_ms;
+    int bucket = 0;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_end);
+    clock_gettime(CLOCK_MONOTONIC, &wall_end);
+    wall_ms = stats_elapsed_ms(&scan->wall_start, &wall_end);
+    cpu_ms = stats_elapsed_ms(&scan->cpu_start, &cpu_end);
+
+    while (bucket < lengthof(stats_latency_bounds_ms) && wall_ms > stats_latency_bounds_ms[bucket]) {
+        bucket++;
+    }
+
+    SpinLockAcquire(&stats->mutex);
+    stats->scans++;
+    stats->pids_visited += pids_visited;
+    stats->files_opened += procfs_counters.files_opened;
+    stats->bytes_read += procfs_counters.bytes_read;
+    stats->parse_failures += procfs_counters.parse_failures;
+    stats->vanished += procfs_counters.vanished;
+    stats->wall_ms += wall_ms;
+    stats->cpu_ms += cpu_ms;
+    stats->max_wall_ms = Max(stats->max_wall_ms, wall_ms);
+    stats->latency[bucket]++;
+    SpinLockRelease(&stats->mutex);
+}
+
+/* Function to count a call served from the shared snapshot */
+void pgsyswatch_stats_cache_hit(PgSysWatchCollector collector) {
+    CollectorStats *stats = &stats_area()->collectors[collector];
+
+    SpinLockAcquire(&stats->mutex);
+    stats->cache_hits++;
+    SpinLockRelease(&stats->mutex);
+}
+
+/* Function to count a parse failure that happened outside of a scan */
+void pgsyswatch_stats_parse_failure(PgSysWatchCollector collector) {
+    CollectorStats *stats = &stats_area()->collectors[collector];
+
+    SpinLockAcquire(&stats->mutex);
+    stats->parse_failures++;
+    SpinLockRelease(&stats->mutex);
+}
+
+/* Function to return the cost counters of every collector */
+PG_FUNCTION_INFO_V1(collector_stats);
+
+Datum collector_stats(PG_FUNCTION_ARGS)
+{
+    FuncCallContext *funcctx;
+    CollectorStats *snapshot;
+
+    if (SRF_IS_FIRSTCALL()) {
+        MemoryContext oldcontext;
+        TupleDesc tupdesc;
+        PgSysWatchStats *area = stats_area();
+        int i;
+
+        funcctx = SRF_FIRSTCALL_INIT();
+        oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+        if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE) {
+            ereport(ERROR,
+                    (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                     errmsg("Function returning record called in context that cannot accept type record")));
+        }
+        funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+        /* Copy the counters out, so that no spinlock is held while forming tuples */
+        snapshot = (CollectorStats *) palloc(sizeof(area->collectors));
+        for (i = 0; i < PGSYSWATCH_NUM_COLLECTORS; i++) {
+            SpinLockAcquire(&area->collectors[i].mutex);
+            snapshot[i] = area->collectors[i];
+            SpinLockRelease(&area->collectors[i].mutex);
+        }
+        funcctx->user_fctx = snapshot;
+        funcctx->max_calls = PGSYSWATCH_NUM_COLLECTORS;
+
+        MemoryContextSwitchTo(oldcontext);
+    }
+
+    funcctx = SRF_PERCALL_SETUP();
+    snapshot = (CollectorStats *) funcctx->user_fctx;
+
+    if (funcctx->call_cntr < funcctx->max_calls) {
+        CollectorStats *stats = &snapshot[funcctx->call_cntr];
+        Datum bounds[STATS_NBUCKETS];
+        Datum counts[STATS_NBUCKETS];
+        Datum values[15];
+        bool nulls[15] = {false};
+        HeapTuple tuple;
+        int b;
+
+        for (b = 0; b < STATS_NBUCKETS; b++) {
+            bounds[b] = Float8GetDatum(b < lengthof(stats_latency_bounds_ms) ? stats_latency_bounds_ms[b] : INFINITY);
+            counts[b] = Int64GetDatum(stats->latency[b]);
+        }
+
+        values[0] = CStringGetTextDatum(stats_collector_names[funcctx->call_cntr]);
+        values[1] = Int64GetDatum(stats->scans);
+        values[2] = Int64GetDatum(stats->cache_hits);
+        values[3] = Int64GetDatum(stats->pids_visited);
+        values[4] = Int64GetDatum(stats->files_opened);
+        values[5] = Int64GetDatum(stats->bytes_read);
+        values[6] = Int64GetDatum(stats->parse_failures);
+        values[7] = Int64GetDatum(stats->vanished);
+        values[8] = Float8GetDatum(stats->wall_ms);
+        values[9] = Float8GetDatum(stats->cpu_ms);
+        if (stats->scans > 0) {
+            values[10] = Float8GetDatum(stats->wall_ms / stats->scans);
+        } else {
+            nulls[10] = true;
+        }
+        values[11] = Float8GetDatum(stats->max_wall_ms);
+        values[12] = PointerGetDatum(construct_array(bounds, STATS_NBUCKETS, FLOAT8OID, 8, FLOAT8PASSBYVAL, TYPALIGN_DOUBLE));
+        values[13] = PointerGetDatum(construct_array(counts, STATS_NBUCKETS, INT8OID, 8, FLOAT8PASSBYVAL, TYPALIGN_DOUBLE));
+        values[14] = TimestampTzGetDatum(stats->stats_reset);
+
+        tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+        SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+    }
+
+    SRF_RETURN_DONE(funcctx);
+}
+
+/* Function to reset the counters of one collector, or of all of them when called with NULL */
+PG_FUNCTION_INFO_V1(collector_stats_reset);
+
+Datum collector_stats_reset(PG_FUNCTION_ARGS)
+{
+    PgSysWatchStats *area = stats_area();
+    TimestampTz now = GetCurrentTimestamp();
+    char *name = PG_ARGISNULL(0) ? NULL : text_to_cstring(PG_GETARG_TEXT_PP(0));
+    bool matched = false;
+    int i;
+
+    for (i = 0; i < PGSYSWATCH_NUM_COLLECTORS; i++) {
+        if (name == NULL || strcmp(name, stats_collector_names[i]) == 0) {
+            SpinLockAcquire(&area->collectors[i].mutex);
+            stats_zero(&area->collectors[i], now);
+            SpinLockRelease(&area->collectors[i].mutex);
+            matched = true;
+        }
+    }
+
+    if (!matched) {
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("unknown collector \"%s\"", name)));
+    }
+
+    PG_RETURN_VOID();
+}
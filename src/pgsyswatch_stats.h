@@ -0,0 +1,53 @@
+/* pgsyswatch_stats.h
+SPDX-License-Identifier: Apache-2.0
+Copyright 2025 Alexander Scheglov */
+#ifndef PGSYSWATCH_STATS_H
+#define PGSYSWATCH_STATS_H
+
+#include "postgres.h"
+#include "fmgr.h"
+#include <time.h>
+
+#include "pgsyswatch_procfs.h"
+
+/* Data sources whose reading cost is accounted, one row of collector_stats() each */
+typedef enum PgSysWatchCollector {
+    PGSYSWATCH_COLLECTOR_PROC_MONITOR_ALL,
+    PGSYSWATCH_COLLECTOR_PROC_MONITOR,
+    PGSYSWATCH_COLLECTOR_NET_MONITOR,
+    PGSYSWATCH_COLLECTOR_LOADAVG,
+    PGSYSWATCH_COLLECTOR_CPU_FREQUENCIES,
+    PGSYSWATCH_COLLECTOR_SYSTEM_INFO,
+    PGSYSWATCH_COLLECTOR_PROC_EVENTS,
+    PGSYSWATCH_COLLECTOR_RELATION_OS_CACHE,
+    PGSYSWATCH_COLLECTOR_PROC_NUMA,
+    PGSYSWATCH_NUM_COLLECTORS
+} PgSysWatchCollector;
+
+/* One scan in progress, on the caller's stack */
+typedef struct CollectorScan {
+    PgSysWatchCollector collector;
+    struct timespec wall_start;
+    struct timespec cpu_start;
+} CollectorScan;
+
+/* Shared memory request and attach, called from the hooks in pgsyswatch.c */
+void pgsyswatch_stats_shmem_request(void);
+void pgsyswatch_stats_shmem_startup(void);
+
+/*
+ * Account one scan: begin zeroes the calling thread's procfs_counters and
+ * starts the clocks, end adds the counters, the elapsed wall and CPU time
+ * and the number of PIDs visited to the collector's statistics. A scan
+ * aborted by an ERROR is simply not accounted.
+ */
+void pgsyswatch_stats_scan_begin(CollectorScan *scan, PgSysWatchCollector collector);
+void pgsyswatch_stats_scan_end(CollectorScan *scan, uint64 pids_visited);
+
+/* Count a call answered from the shared snapshot cache */
+void pgsyswatch_stats_cache_hit(PgSysWatchCollector collector);
+
+/* Count a parse failure noticed outside of a scan */
+void pgsyswatch_stats_parse_failure(PgSysWatchCollector collector);
+
+#endif  /* PGSYSWATCH_STATS_H */
@@ -15,39 +15,20 @@
 #include <string.h>
 #include <ctype.h> // For isdigit
 #include "pgsyswatch_common.h"
-
-// Structure to store swap information
-typedef struct SystemSwapInfo
-{
-    float total_swap;  // In kilobytes
-    float used_swap;   // In kilobytes
-    float free_swap;   // In kilobytes
-} SystemSwapInfo;
-
-// Structure to store CPU frequency information
-typedef struct CpuFrequencyInfo {
-    int core_id;        // Core ID
-    float frequency_mhz; // Frequency in MHz
-} CpuFrequencyInfo;
-
-// Function to clean a string of non-numeric characters (except for '.')
-void clean_string(char *str) {
-    char *src = str;
-    char *dst = str;
-    while (*src) {
-        if (isdigit(*src) || *src == '.') {
-            *dst++ = *src;
-        }
-        src++;
-    }
-    *dst = '\0';
-}
+#include "system_info.h"
+#include "pgsyswatch_cache.h"
+#include "pgsyswatch_stats.h"
 
 // Function to get swap information from /proc/meminfo
 SystemSwapInfo get_system_swap_info()
 {
     SystemSwapInfo swap_info = {0};
-    FILE *file = fopen("/proc/meminfo", "r");
+    CollectorScan scan;
+    pgsyswatch_stats_scan_begin(&scan, PGSYSWATCH_COLLECTOR_SYSTEM_INFO);
+
+    char path[MAXPGPATH];
+    snprintf(path, sizeof(path), "%s/meminfo", procfs_root());
+    FILE *file = procfs_fopen(path);
     if (file != NULL)
     {
         char line[256];
@@ -62,9 +43,10 @@ SystemSwapInfo get_system_swap_info()
                 sscanf(line, "SwapFree: %f", &swap_info.free_swap);
             }
         }
-        fclose(file);
+        procfs_fclose(file);
         swap_info.used_swap = swap_info.total_swap - swap_info.free_swap;
     }
+    pgsyswatch_stats_scan_end(&scan, 0);
     return swap_info;
 }
 
@@ -106,55 +88,59 @@ Datum system_info(PG_FUNCTION_ARGS)
 
 // Function to get the number of CPU cores
 int get_cpu_cores() {
-    FILE *file;
-    int cores = 0;
-    char line[256];
+    int cores = procfs_count_cpus();
 
-    file = fopen("/proc/cpuinfo", "r");
-    if (file == NULL) {
+    if (cores < 0) {
         ereport(ERROR,
                 (errcode_for_file_access(),
-                 errmsg("could not open /proc/cpuinfo: %m")));
-    }
-
-    while (fgets(line, sizeof(line), file)) {
-        if (strncmp(line, "processor", 9) == 0) {
-            cores++;
-        }
+                 errmsg("could not open %s/cpuinfo: %m", procfs_root())));
     }
-
-    fclose(file);
     return cores;
 }
 
-// Function to get the system load average
-PG_FUNCTION_INFO_V1(pg_loadavg);
-
-Datum pg_loadavg(PG_FUNCTION_ARGS)
+// Function to read the system load average from /proc/loadavg
+LoadAvgInfo get_loadavg_info()
 {
     FILE *file;
-    float load1, load5, load15;
-    int running_processes, total_processes, last_pid;
-    int cpu_cores = get_cpu_cores();
+    LoadAvgInfo info = {0};
+    char path[MAXPGPATH];
+    CollectorScan scan;
+
+    pgsyswatch_stats_scan_begin(&scan, PGSYSWATCH_COLLECTOR_LOADAVG);
 
     // Open /proc/loadavg file
-    file = fopen("/proc/loadavg", "r");
+    snprintf(path, sizeof(path), "%s/loadavg", procfs_root());
+    file = procfs_fopen(path);
     if (file == NULL)
     {
         ereport(ERROR,
                 (errcode_for_file_access(),
-                 errmsg("could not open /proc/loadavg: %m")));
+                 errmsg("could not open %s: %m", path)));
     }
 
     // Read load average and process count
-    if (fscanf(file, "%f %f %f %d/%d %d", &load1, &load5, &load15, &running_processes, &total_processes, &last_pid) != 6)
+    if (fscanf(file, "%f %f %f %d/%d %d", &info.load1, &info.load5, &info.load15,
+               &info.running_processes, &info.total_processes, &info.last_pid) != 6)
     {
-        fclose(file);
+        procfs_fclose(file);
+        pgsyswatch_stats_parse_failure(PGSYSWATCH_COLLECTOR_LOADAVG);
         ereport(ERROR,
                 (errcode(ERRCODE_DATA_EXCEPTION),
                  errmsg("could not parse /proc/loadavg")));
     }
-    fclose(file);
+    procfs_fclose(file);
+
+    info.cpu_cores = get_cpu_cores();
+    pgsyswatch_stats_scan_end(&scan, 0);
+    return info;
+}
+
+// Function to get the system load average
+PG_FUNCTION_INFO_V1(pg_loadavg);
+
+Datum pg_loadavg(PG_FUNCTION_ARGS)
+{
+    LoadAvgInfo info = pgsyswatch_cached_loadavg(pgsyswatch_cache_staleness_arg(fcinfo, 0));
 
     // Define the return columns
     TupleDesc tupdesc = CreateTemplateTupleDesc(7);
@@ -173,13 +159,13 @@ Datum pg_loadavg(PG_FUNCTION_ARGS)
     Datum values[7];
     bool nulls[7] = {false};
 
-    values[0] = Float4GetDatum(load1);
-    values[1] = Float4GetDatum(load5);
-    values[2] = Float4GetDatum(load15);
-    values[3] = Int32GetDatum(running_processes);
-    values[4] = Int32GetDatum(total_processes);
-    values[5] = Int32GetDatum(last_pid);
-    values[6] = Int32GetDatum(cpu_cores);
+    values[0] = Float4GetDatum(info.load1);
+    values[1] = Float4GetDatum(info.load5);
+    values[2] = Float4GetDatum(info.load15);
+    values[3] = Int32GetDatum(info.running_processes);
+    values[4] = Int32GetDatum(info.total_processes);
+    values[5] = Int32GetDatum(info.last_pid);
+    values[6] = Int32GetDatum(info.cpu_cores);
 
     // Create a tuple
     HeapTuple tuple = heap_form_tuple(tupdesc, values, nulls);
@@ -190,51 +176,23 @@ Datum pg_loadavg(PG_FUNCTION_ARGS)
 
 // Function to get the frequency of each CPU core
 CpuFrequencyInfo* get_cpu_frequencies(int *num_cores) {
-    FILE *file;
-    char line[256];
-    int core_id = -1;
-    float frequency_mhz = 0.0;
-    int index = 0;
-
-    file = fopen("/proc/cpuinfo", "r");
-    if (file == NULL) {
-        ereport(ERROR,
-                (errcode_for_file_access(),
-                 errmsg("could not open /proc/cpuinfo: %m")));
-    }
+    CollectorScan scan;
+    pgsyswatch_stats_scan_begin(&scan, PGSYSWATCH_COLLECTOR_CPU_FREQUENCIES);
 
     // Count the number of cores
-    *num_cores = get_cpu_cores();
+    int cores = get_cpu_cores();
 
-    CpuFrequencyInfo *frequencies = (CpuFrequencyInfo *) palloc(*num_cores * sizeof(CpuFrequencyInfo));
-    if (frequencies == NULL) {
-        ereport(ERROR,
-                (errcode(ERRCODE_OUT_OF_MEMORY),
-                 errmsg("could not allocate memory for CPU frequencies")));
-    }
+    CpuFrequencyInfo *frequencies = (CpuFrequencyInfo *) palloc(Max(cores, 1) * sizeof(CpuFrequencyInfo));
 
-    while (fgets(line, sizeof(line), file)) {
-        if (strncmp(line, "processor", 9) == 0) {
-            sscanf(line, "processor : %d", &core_id);
-        } else if (strncmp(line, "cpu MHz", 7) == 0) {
-            char frequency_str[32];
-            if (sscanf(line, "cpu MHz : %s", frequency_str) == 1) {
-                clean_string(frequency_str); // Clean the string of non-numeric characters
-                frequency_mhz = atof(frequency_str); // Convert to float
-            } else {
-                frequency_mhz = 0.0; // Set default value
-            }
-            if (core_id != -1) {
-                frequencies[index].core_id = core_id;
-                frequencies[index].frequency_mhz = frequency_mhz;
-                index++;
-                core_id = -1;
-            }
-        }
+    // Only cores that report a "cpu MHz" line are returned
+    *num_cores = procfs_read_cpu_frequencies(frequencies, cores);
+    if (*num_cores < 0) {
+        ereport(ERROR,
+                (errcode_for_file_access(),
+                 errmsg("could not open %s/cpuinfo: %m", procfs_root())));
     }
 
-    fclose(file);
-
+    pgsyswatch_stats_scan_end(&scan, 0);
     return frequencies;
 }
 
@@ -302,3 +260,70 @@ Datum cpu_frequencies(PG_FUNCTION_ARGS) {
         SRF_RETURN_DONE(funcctx);
     }
 }
+
+// Function to return every field of /proc/meminfo
+PG_FUNCTION_INFO_V1(os_meminfo);
+
+Datum os_meminfo(PG_FUNCTION_ARGS) {
+    FuncCallContext *funcctx;
+    MeminfoField    *fields;
+
+    if (SRF_IS_FIRSTCALL()) {
+        MemoryContext oldcontext;
+        TupleDesc tupdesc;
+        CollectorScan scan;
+        int count;
+
+        funcctx = SRF_FIRSTCALL_INIT();
+        oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+        // Define the return columns: field, value, unit, mb
+        tupdesc = CreateTemplateTupleDesc(4);
+        TupleDescInitEntry(tupdesc, (AttrNumber) 1, "field", TEXTOID, -1, 0);
+        TupleDescInitEntry(tupdesc, (AttrNumber) 2, "value", INT8OID, -1, 0);
+        TupleDescInitEntry(tupdesc, (AttrNumber) 3, "unit", TEXTOID, -1, 0);
+        TupleDescInitEntry(tupdesc, (AttrNumber) 4, "mb", FLOAT8OID, -1, 0);
+        funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+        // Same file as system_swap_info(), so it is accounted the same way
+        pgsyswatch_stats_scan_begin(&scan, PGSYSWATCH_COLLECTOR_SYSTEM_INFO);
+        fields = (MeminfoField *) palloc(PROCFS_MEMINFO_MAX_FIELDS * sizeof(MeminfoField));
+        count = procfs_read_meminfo(fields, PROCFS_MEMINFO_MAX_FIELDS);
+        if (count < 0) {
+            ereport(ERROR,
+                    (errcode_for_file_access(),
+                     errmsg("could not open %s/meminfo: %m", procfs_root())));
+        }
+        pgsyswatch_stats_scan_end(&scan, 0);
+
+        funcctx->user_fctx = fields;
+        funcctx->max_calls = count;
+
+        MemoryContextSwitchTo(oldcontext);
+    }
+
+    funcctx = SRF_PERCALL_SETUP();
+    fields = (MeminfoField *) funcctx->user_fctx;
+
+    if (funcctx->call_cntr < funcctx->max_calls) {
+        MeminfoField *field = &fields[funcctx->call_cntr];
+        Datum values[4];
+        bool nulls[4] = {false};
+
+        values[0] = CStringGetTextDatum(field->name);
+        values[1] = Int64GetDatum(field->value);
+        // Counts such as HugePages_Total have no unit and no size
+        if (field->in_kb) {
+            values[2] = CStringGetTextDatum("kB");
+            values[3] = Float8GetDatum(field->value / 1024.0);
+        } else {
+            nulls[2] = true;
+            nulls[3] = true;
+        }
+
+        HeapTuple tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+        SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+    }
+
+    SRF_RETURN_DONE(funcctx);
+}
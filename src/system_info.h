@@ -5,6 +5,7 @@
 
 #include "postgres.h"
 #include "fmgr.h"
+#include "pgsyswatch_procfs.h"
 
 typedef struct SystemSwapInfo {
     float total_swap; 
@@ -12,14 +13,20 @@ typedef struct SystemSwapInfo {
     float free_swap; 
 } SystemSwapInfo;
 
-typedef struct CpuFrequencyInfo {
-    int core_id; 
-    float frequency_mhz;
-} CpuFrequencyInfo;
+typedef struct LoadAvgInfo {
+    float load1;
+    float load5;
+    float load15;
+    int running_processes;
+    int total_processes;
+    int last_pid;
+    int cpu_cores;
+} LoadAvgInfo;
 
 // Функции
 SystemSwapInfo get_system_swap_info();
 int get_cpu_cores();
 CpuFrequencyInfo* get_cpu_frequencies(int *num_cores);
+LoadAvgInfo get_loadavg_info();
 
 #endif